@@ -0,0 +1,332 @@
+#include <zest/editor.hpp>
+#include <zest/input.hpp>
+#include <zest/text.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+// Drives the editor core without a window: every frame gets scripted input,
+// goes through update and is rasterized into the text area pixels, just as
+// the CPU renderer does it before the upload. Prints one JSON object per
+// scenario to stdout, progress goes to stderr.
+
+static constexpr double frame_delta = 1.0/60.0;
+
+static std::string generate_source(size_t line_count)
+{
+    std::string text;
+
+    for (size_t i = 0; i < line_count; i += 9)
+    {
+        std::string name = "function_" + std::to_string(i);
+        text += "bool " + name + "(int x)\n"
+                "{\n"
+                "    if (x > 3)\n"
+                "        return true;\n"
+                "    for (int i = 0; i < x; ++i)\n"
+                "        x += i;\n"
+                "    return false;\n"
+                "}\n"
+                "\n";
+    }
+
+    return text;
+}
+
+struct Bench
+{
+    LineBuffer line_buffer;
+    Editor editor;
+    CursorState cursor;
+};
+
+// Returns the time the frame took in microseconds.
+static double run_frame(Bench& bench, const zest::InputState& input)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    update(bench.line_buffer, bench.cursor, bench.editor, input, frame_delta);
+    update_syntax_tree(bench.editor, bench.line_buffer);
+
+    int first_row, last_row;
+    visible_rows(bench.editor, first_row, last_row);
+
+    update_damage(bench.cursor, bench.editor, first_row, last_row);
+    update_highlights(bench.editor, first_row, last_row);
+    draw_damage(bench.line_buffer, bench.cursor, bench.editor,
+                first_row, last_row);
+    bench.editor.damage.clear();
+
+    std::chrono::duration<double, std::micro> time =
+        std::chrono::steady_clock::now() - start;
+    return time.count();
+}
+
+// Puts the view, the cursor and the selection back to the start, so every
+// scenario begins from the same place.
+static void reset_view(Bench& bench)
+{
+    bench.cursor = CursorState();
+    bench.editor.file_space_x = 0.0f;
+    bench.editor.file_space_y = 0.0f;
+    bench.editor.selecting = false;
+    bench.editor.selection_valid = false;
+    bench.editor.extra_cursors.clear();
+    bench.editor.cursors_version++;
+
+    run_frame(bench, {});
+}
+
+static void wait_for_tree(Bench& bench)
+{
+    while (!bench.editor.tree)
+    {
+        update_syntax_tree(bench.editor, bench.line_buffer);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+static void report(std::string_view scenario, const Bench& bench,
+                   std::vector<double> samples)
+{
+    std::sort(samples.begin(), samples.end());
+
+    double sum = 0;
+    for (double sample : samples)
+        sum += sample;
+
+    auto percentile = [&] (size_t p)
+    {
+        return samples[std::min(samples.size()*p/100, samples.size() - 1)];
+    };
+
+    std::cout << "{\"scenario\":\"" << scenario << "\""
+              << ",\"lines\":" << bench.line_buffer.line_count()
+              << ",\"frames\":" << samples.size()
+              << ",\"frames_per_s\":" << samples.size()/(sum/1e6)
+              << ",\"mean_us\":" << sum/samples.size()
+              << ",\"p50_us\":" << percentile(50)
+              << ",\"p90_us\":" << percentile(90)
+              << ",\"p99_us\":" << percentile(99)
+              << ",\"max_us\":" << samples.back()
+              << "}" << std::endl;
+}
+
+// Wheel scrolling down through the file, three lines a frame.
+static std::vector<double> scroll(Bench& bench, int frames)
+{
+    std::vector<double> samples;
+
+    zest::InputState input;
+    input.wheel = -3.0f;
+    for (int i = 0; i < frames; ++i)
+        samples.push_back(run_frame(bench, input));
+
+    return samples;
+}
+
+// Bursts of typing in the middle of the file: twenty characters, a new
+// line and a short pause, while the parser keeps reparsing behind it.
+static std::vector<double> typing(Bench& bench, int frames)
+{
+    Editor& editor = bench.editor;
+    editor.file_space_y =
+        int(bench.line_buffer.line_count()/2)*editor.cell_height;
+
+    zest::InputState click;
+    click.mouse_pos = { editor.top_left_x + 4*editor.cell_width,
+                        editor.top_left_y + 10*editor.cell_height };
+    click.mouse_pressed = true;
+    run_frame(bench, click);
+
+    zest::InputState release;
+    release.mouse_released = true;
+    run_frame(bench, release);
+
+    std::string_view burst = "int value = x*2 + 1;";
+
+    std::vector<double> samples;
+    for (int i = 0; i < frames; ++i)
+    {
+        int step = i % 32;
+
+        zest::InputState input;
+        if (step < int(burst.size()))
+        {
+            input.text = burst[step];
+        }
+        else if (step == int(burst.size()))
+        {
+            input.key(zest::InputState::Key::enter).pressed = true;
+            input.key(zest::InputState::Key::enter).down = true;
+        }
+
+        samples.push_back(run_frame(bench, input));
+    }
+
+    return samples;
+}
+
+// The bursts of typing, but at the start of an if in each of the first
+// ten thousand functions at once, as after selecting all occurrences.
+static std::vector<double> multi_cursor(Bench& bench, int frames)
+{
+    Editor& editor = bench.editor;
+
+    int cursor_count = std::min<int>(10000,
+                                     bench.line_buffer.line_count()/9);
+    for (int i = 1; i < cursor_count; ++i)
+    {
+        zest::CellPos pos = { 9*i + 2, 4 };
+        editor.extra_cursors.push_back({ pos, pos });
+    }
+    editor.cursors_version++;
+
+    bench.cursor.line = 2;
+    bench.cursor.col = 4;
+    bench.cursor.original_col = 4;
+
+    std::string_view burst = "int value = x*2 + 1;";
+
+    std::vector<double> samples;
+    for (int i = 0; i < frames; ++i)
+    {
+        int step = i % 32;
+
+        zest::InputState input;
+        if (step < int(burst.size()))
+        {
+            input.text = burst[step];
+        }
+        else if (step == int(burst.size()))
+        {
+            input.key(zest::InputState::Key::enter).pressed = true;
+            input.key(zest::InputState::Key::enter).down = true;
+        }
+
+        samples.push_back(run_frame(bench, input));
+    }
+
+    return samples;
+}
+
+// Drags a selection from the top of the view while the wheel keeps
+// scrolling, so the selection grows by thirty lines every frame.
+static std::vector<double> selection(Bench& bench, int frames)
+{
+    Editor& editor = bench.editor;
+
+    zest::InputState input;
+    input.mouse_pos = { float(editor.top_left_x + 1),
+                        float(editor.top_left_y + 1) };
+    input.mouse_pressed = true;
+    input.mouse_down = true;
+    run_frame(bench, input);
+
+    input.mouse_pressed = false;
+    input.mouse_pos.y = editor.top_left_y + editor.height - 1;
+    input.wheel = -30.0f;
+
+    std::vector<double> samples;
+    for (int i = 0; i < frames; ++i)
+        samples.push_back(run_frame(bench, input));
+
+    input = {};
+    input.mouse_released = true;
+    run_frame(bench, input);
+
+    return samples;
+}
+
+int main(int argc, char** argv)
+{
+    size_t lines = 1000000;
+    int frames = 2000;
+    int width = 1280;
+    int height = 720;
+    std::vector<std::string> scenarios;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view arg = argv[i];
+
+        if (arg.substr(0, 8) == "--lines=")
+        {
+            lines = std::strtoull(argv[i] + 8, nullptr, 10);
+        }
+        else if (arg.substr(0, 9) == "--frames=")
+        {
+            frames = std::max(1, std::atoi(argv[i] + 9));
+        }
+        else if (arg.substr(0, 11) == "--scenario=")
+        {
+            scenarios.push_back(std::string(arg.substr(11)));
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--lines=N] [--frames=N]"
+                         " [--scenario=scroll|typing|selection"
+                         "|multi_cursor]...\n";
+            return 1;
+        }
+    }
+
+    if (scenarios.empty())
+        scenarios = { "scroll", "typing", "selection", "multi_cursor" };
+
+    Bench bench;
+    bench.line_buffer = LineBuffer(generate_source(lines));
+
+    init_editor(bench.editor, width, height);
+    bench.editor.highlight_cache.reset(bench.line_buffer.line_count());
+
+    std::cerr << "Parsing " << bench.line_buffer.line_count()
+              << " lines...\n";
+
+    auto parse_start = std::chrono::steady_clock::now();
+    update_syntax_tree(bench.editor, bench.line_buffer);
+    wait_for_tree(bench);
+    std::chrono::duration<double, std::milli> parse_time =
+        std::chrono::steady_clock::now() - parse_start;
+
+    std::cout << "{\"scenario\":\"initial_parse\""
+              << ",\"lines\":" << bench.line_buffer.line_count()
+              << ",\"ms\":" << parse_time.count()
+              << "}" << std::endl;
+
+    using Scenario = std::function<std::vector<double>(Bench&, int)>;
+    std::pair<std::string_view, Scenario> all_scenarios[] = {
+        { "scroll", scroll },
+        { "typing", typing },
+        { "selection", selection },
+        { "multi_cursor", multi_cursor },
+    };
+
+    for (const std::string& name : scenarios)
+    {
+        auto it = std::find_if(std::begin(all_scenarios),
+                               std::end(all_scenarios),
+                               [&] (const auto& scenario)
+                               {
+                                   return scenario.first == name;
+                               });
+        if (it == std::end(all_scenarios))
+        {
+            std::cerr << "Unknown scenario '" << name << "'\n";
+            return 1;
+        }
+
+        std::cerr << "Running " << name << "...\n";
+        reset_view(bench);
+        report(name, bench, it->second(bench, frames));
+    }
+}
@@ -0,0 +1,184 @@
+#include <zest/highlight/cache.hpp>
+#include <zest/text.hpp>
+#include <zest/tree_sitter.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+// Lines visible in the default editor view and the prefetch margin the
+// editor uses.
+static constexpr int view_lines = 24;
+static constexpr int margin = 64;
+static constexpr int frames = 200;
+
+static std::string generate_source(size_t line_count)
+{
+    std::string text;
+
+    for (size_t i = 0; i < line_count; i += 9)
+    {
+        std::string name = "function_" + std::to_string(i);
+        text += "bool " + name + "(int x)\n"
+                "{\n"
+                "    if (x > 3)\n"
+                "        return true;\n"
+                "    for (int i = 0; i < x; ++i)\n"
+                "        x += i;\n"
+                "    return false;\n"
+                "}\n"
+                "\n";
+    }
+
+    return text;
+}
+
+class Timer
+{
+public:
+    void start() { start_ = std::chrono::steady_clock::now(); }
+    void stop()
+    {
+        std::chrono::duration<double, std::micro> time =
+            std::chrono::steady_clock::now() - start_;
+        samples_.push_back(time.count());
+    }
+
+    void report(const char* name)
+    {
+        std::sort(samples_.begin(), samples_.end());
+
+        double sum = 0;
+        for (double sample : samples_)
+            sum += sample;
+
+        std::cout << "  " << name
+                  << ": mean " << sum/samples_.size() << " us"
+                  << ", p99 " << samples_[samples_.size()*99/100] << " us\n";
+        samples_.clear();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+    std::vector<double> samples_;
+};
+
+static void rebuild_view(zest::highlight::SpanCache& cache,
+                         const TSTree* tree,
+                         const zest::tree_sitter::HighlightQueries& queries,
+                         TSQueryCursor* query_cursor,
+                         int first_row)
+{
+    cache.rebuild(tree, queries, query_cursor,
+                  std::max(0, first_row - margin),
+                  first_row + view_lines + margin);
+}
+
+static void query_whole_tree(const TSTree* tree,
+                             const TSQuery* query,
+                             TSQueryCursor* query_cursor)
+{
+    ts_query_cursor_set_point_range(query_cursor, { 0, 0 },
+                                    { UINT32_MAX, UINT32_MAX });
+    ts_query_cursor_exec(query_cursor, query, ts_tree_root_node(tree));
+
+    TSQueryMatch match;
+    uint32_t capture_idx;
+    while (ts_query_cursor_next_capture(query_cursor, &match, &capture_idx))
+    { }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<size_t> sizes = { 1000, 10000, 100000, 1000000 };
+    if (argc > 1)
+    {
+        sizes.clear();
+        for (int i = 1; i < argc; ++i)
+            sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+    }
+
+    zest::tree_sitter::ParserPtr parser = zest::tree_sitter::init();
+    zest::tree_sitter::HighlightQueries queries =
+        zest::tree_sitter::init_highlight_queries(parser.get());
+    zest::tree_sitter::QueryCursorPtr query_cursor =
+        zest::tree_sitter::init_query_cursor();
+
+    std::mt19937 rng(7);
+
+    for (size_t size : sizes)
+    {
+        LineBuffer line_buffer(generate_source(size));
+        int rows = line_buffer.line_count();
+
+        std::cout << rows << " lines\n";
+
+        Timer timer;
+
+        timer.start();
+        zest::tree_sitter::TreePtr tree =
+            zest::tree_sitter::parse_text(parser.get(), line_buffer);
+        timer.stop();
+        timer.report("initial parse");
+
+        zest::highlight::SpanCache cache;
+        cache.reset(rows);
+        cache.invalidate_changes(nullptr, tree.get());
+
+        std::uniform_int_distribution<int> row(0, rows - view_lines);
+
+        for (int i = 0; i < frames; ++i)
+        {
+            int first_row = row(rng);
+            timer.start();
+            rebuild_view(cache, tree.get(), queries, query_cursor.get(),
+                         first_row);
+            timer.stop();
+        }
+        timer.report("frame after jump to a random line");
+
+        int first_row = rows/2;
+        rebuild_view(cache, tree.get(), queries, query_cursor.get(),
+                     first_row);
+        for (int i = 0; i < frames; ++i)
+        {
+            timer.start();
+            rebuild_view(cache, tree.get(), queries, query_cursor.get(),
+                         first_row);
+            timer.stop();
+        }
+        timer.report("idle frame");
+
+        for (int i = 0; i < frames; ++i)
+        {
+            zest::CellPos pos = { first_row + view_lines/2, 4 };
+            zest::TextEdit edit = line_buffer.insert(pos, "x");
+
+            timer.start();
+            zest::tree_sitter::edit_tree(tree.get(), edit);
+            cache.apply_edit(edit);
+            rebuild_view(cache, tree.get(), queries, query_cursor.get(),
+                         first_row);
+            timer.stop();
+        }
+        timer.report("frame after typing a character");
+
+        if (rows <= 100000)
+        {
+            for (int i = 0; i < 10; ++i)
+            {
+                timer.start();
+                query_whole_tree(tree.get(), queries.query.get(),
+                                 query_cursor.get());
+                timer.stop();
+            }
+            timer.report("whole-tree query (previous per-frame cost)");
+        }
+    }
+}
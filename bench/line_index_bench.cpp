@@ -0,0 +1,116 @@
+#include <zest/newlines.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// Source-like text: lines of 0 to 120 characters with some indentation.
+static std::string generate_text(size_t size)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> line_length(0, 120);
+    std::uniform_int_distribution<int> letter('a', 'z');
+
+    std::string text;
+    text.reserve(size);
+
+    while (text.size() < size)
+    {
+        int len = line_length(rng);
+        for (int i = 0; i < len && text.size() < size; ++i)
+            text.push_back(i < 4 ? ' ' : char(letter(rng)));
+        if (text.size() < size)
+            text.push_back('\n');
+    }
+
+    return text;
+}
+
+static std::vector<size_t> getline_newlines(const std::string& text)
+{
+    std::vector<size_t> newlines;
+    std::istringstream stream(text);
+
+    size_t offset = 0;
+    std::string line;
+    while (std::getline(stream, line))
+    {
+        offset += line.size();
+        if (offset < text.size())
+            newlines.push_back(offset);
+        offset++;
+    }
+
+    return newlines;
+}
+
+template<typename Func>
+static double best_of(int runs, Func func)
+{
+    double best = 1e30;
+    for (int i = 0; i < runs; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        std::chrono::duration<double, std::milli> time =
+            std::chrono::steady_clock::now() - start;
+        best = std::min(best, time.count());
+    }
+    return best;
+}
+
+static void report(const char* name, size_t size, double ms)
+{
+    double gb_per_s = size/(ms/1000.0)/1e9;
+    std::cout << "  " << name << ": " << ms << " ms, "
+              << gb_per_s << " GB/s\n";
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<size_t> sizes_mb = { 100, 1024 };
+    if (argc > 1)
+    {
+        sizes_mb.clear();
+        for (int i = 1; i < argc; ++i)
+            sizes_mb.push_back(std::strtoull(argv[i], nullptr, 10));
+    }
+
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (size_t mb : sizes_mb)
+    {
+        std::string text = generate_text(mb*1024*1024);
+        std::vector<size_t> expected = zest::find_newlines(text.data(),
+                                                           text.size(), 1);
+
+        std::cout << mb << " MB, " << expected.size() + 1 << " lines\n";
+
+        int runs = mb > 256 ? 1 : 3;
+
+        report("getline", text.size(), best_of(runs, [&] {
+            if (getline_newlines(text) != expected)
+                std::cerr << "getline mismatch\n";
+        }));
+
+        for (unsigned count = 1; ; count = std::min(count*2, threads))
+        {
+            std::string name = std::to_string(count) + " thread(s)";
+            report(name.c_str(), text.size(), best_of(runs, [&] {
+                if (zest::find_newlines(text.data(), text.size(), count)
+                        != expected)
+                    std::cerr << "mismatch with " << count << " threads\n";
+            }));
+
+            if (count == threads)
+                break;
+        }
+    }
+}
@@ -1,53 +1,32 @@
 #include "app.hpp"
 
 
-static int measure_char_width(FontInfo font_info)
+void resize_app(App& app, int width, int height)
 {
-    Vector2 dims = MeasureTextEx(font_info.font, "A", font_info.font_size,
-                                 font_info.char_spacing);
-    return dims.x;
-}
-
-App init_app(int window_width, int window_height)
-{
-    App app;
-
     Editor& editor = app.editor;
 
-    editor.top_left_x = 20;
-    editor.top_left_y = 20;
-    editor.width = 600;
-    editor.height = 400;
-    editor.text_area_rect = zest::Rect {
-        (float)editor.top_left_x, (float)editor.top_left_y,
-        (float)editor.width, (float)editor.height
-    };
+    resize_editor(editor, width, height);
 
-    editor.file_space_x = 0.0f;
-    editor.file_space_y = 0.0f;
-    editor.view_rect = zest::Rect {
-        editor.file_space_x, editor.file_space_y,
-        (float)editor.width, (float)editor.height
-    };
+    if (app.text_area_texture.id != 0)
+        UnloadTexture(app.text_area_texture);
 
-    editor.font_info.font_size = 18;
-    editor.font_info.font = LoadFontEx("../resources/FiraCode-Regular.ttf",
-                                       editor.font_info.font_size,
-                                       NULL,
-                                       0);
-    editor.font_info.char_spacing = 1;
-    editor.font_info.char_step = editor.font_info.char_spacing
-                        + measure_char_width(editor.font_info);
+    Image image = {
+        editor.text_area_pixels.data(), editor.width, editor.height,
+        1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8
+    };
+    app.text_area_texture = LoadTextureFromImage(image);
+}
 
-    editor.cell_width = editor.font_info.char_step;
-    editor.cell_height = editor.font_info.font_size;
+App init_app(int window_width, int window_height, Renderer renderer)
+{
+    App app;
 
-    editor.text_area_image = GenImageColor(editor.width, editor.height,
-                                           { 0, 0, 255, 255 });
+    init_editor(app.editor, 600, 400);
+    resize_app(app, app.editor.width, app.editor.height);
 
-    editor.parser = zest::tree_sitter::init();
-    editor.queries = zest::tree_sitter::init_highlight_queries(editor.parser.get());
-    editor.query_cursor = zest::tree_sitter::init_query_cursor();
+    if (renderer == Renderer::gpu)
+        app.gpu_text =
+            std::make_unique<zest::raylib::GpuText>(*app.editor.glyph_atlas);
 
     return app;
 }
@@ -0,0 +1,297 @@
+#include "bdf.hpp"
+
+#include <zest/font_cache.hpp>
+#include <zest/mapped_file.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+
+
+namespace
+{
+
+class Parser
+{
+public:
+    Parser(const std::string& path, std::string_view text)
+        : path_(path), text_(text)
+    { }
+
+    bool next_line()
+    {
+        if (pos_ >= text_.size())
+            return false;
+
+        size_t end = text_.find('\n', pos_);
+        if (end == std::string_view::npos)
+            end = text_.size();
+
+        line_ = text_.substr(pos_, end - pos_);
+        if (!line_.empty() && line_.back() == '\r')
+            line_.remove_suffix(1);
+
+        pos_ = end + 1;
+        line_number_++;
+
+        return true;
+    }
+
+    // First word of the line, the rest is read with next_int.
+    std::string_view keyword()
+    {
+        size_t end = line_.find(' ');
+        std::string_view word = line_.substr(0, end);
+        args_ = end == std::string_view::npos
+                    ? std::string_view()
+                    : line_.substr(end + 1);
+        return word;
+    }
+
+    int next_int()
+    {
+        while (!args_.empty() && args_.front() == ' ')
+            args_.remove_prefix(1);
+
+        int value;
+        auto [end, error] = std::from_chars(args_.data(),
+                                            args_.data() + args_.size(),
+                                            value);
+        if (error != std::errc())
+            fail("expected a number");
+
+        args_.remove_prefix(end - args_.data());
+        return value;
+    }
+
+    std::string_view line() const { return line_; }
+
+    [[noreturn]] void fail(const char* message) const
+    {
+        throw std::runtime_error(path_ + ":" + std::to_string(line_number_)
+                                 + ": " + message);
+    }
+
+private:
+    const std::string& path_;
+    std::string_view text_;
+    size_t pos_ = 0;
+
+    std::string_view line_;
+    std::string_view args_;
+    int line_number_ = 0;
+};
+
+int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+} // namespace
+
+static zest::BitmapFont parse_bdf(const std::string& path,
+                                  std::string_view text)
+{
+    using namespace zest;
+
+    Parser parser(path, text);
+
+    BitmapFont font;
+
+    int box_width = 0;
+    int box_height = 0;
+    int box_x = 0;
+    int box_y = 0;
+    int ascent = -1;
+    int descent = -1;
+
+    // Font header, up to the first glyph.
+    bool has_box = false;
+    while (parser.next_line())
+    {
+        std::string_view keyword = parser.keyword();
+
+        if (keyword == "FONTBOUNDINGBOX")
+        {
+            box_width = parser.next_int();
+            box_height = parser.next_int();
+            box_x = parser.next_int();
+            box_y = parser.next_int();
+            has_box = true;
+        }
+        else if (keyword == "FONT_ASCENT")
+        {
+            ascent = parser.next_int();
+        }
+        else if (keyword == "FONT_DESCENT")
+        {
+            descent = parser.next_int();
+        }
+        else if (keyword == "CHARS")
+        {
+            int count = parser.next_int();
+            font.glyphs.reserve(std::max(count, 0));
+            break;
+        }
+    }
+
+    if (!has_box)
+        parser.fail("missing FONTBOUNDINGBOX");
+
+    if (ascent < 0 || descent < 0)
+    {
+        ascent = box_height + box_y;
+        descent = -box_y;
+    }
+
+    font.cell_width = box_width;
+    font.cell_height = ascent + descent;
+    font.ascent = ascent;
+
+    // Glyphs.
+    BitmapGlyph glyph = {};
+    int encoding = -1;
+    int rows_left = 0;
+    bool in_char = false;
+
+    while (parser.next_line())
+    {
+        if (rows_left > 0)
+        {
+            std::string_view hex = parser.line();
+            size_t row_size = bitmap_row_size(glyph.width);
+            if (hex.size() < row_size*2)
+                parser.fail("bitmap row too short");
+
+            for (size_t i = 0; i < row_size; ++i)
+            {
+                int high = hex_digit(hex[2*i]);
+                int low = hex_digit(hex[2*i + 1]);
+                if (high < 0 || low < 0)
+                    parser.fail("invalid bitmap row");
+                font.bitmaps.push_back(uint8_t(high << 4 | low));
+            }
+
+            rows_left--;
+            continue;
+        }
+
+        std::string_view keyword = parser.keyword();
+
+        if (keyword == "STARTCHAR")
+        {
+            glyph = {};
+            encoding = -1;
+            in_char = true;
+        }
+        else if (!in_char)
+        {
+            if (keyword == "ENDFONT")
+                break;
+        }
+        else if (keyword == "ENCODING")
+        {
+            encoding = parser.next_int();
+        }
+        else if (keyword == "BBX")
+        {
+            int width = parser.next_int();
+            int height = parser.next_int();
+            int x = parser.next_int();
+            int y = parser.next_int();
+
+            if (width < 0 || height < 0)
+                parser.fail("invalid BBX");
+
+            glyph.width = width;
+            glyph.height = height;
+            glyph.x = x - box_x;
+            glyph.y = ascent - (y + height);
+        }
+        else if (keyword == "BITMAP")
+        {
+            glyph.bitmap_offset = font.bitmaps.size();
+            rows_left = glyph.height;
+        }
+        else if (keyword == "ENDCHAR")
+        {
+            // Glyphs without a Unicode encoding cannot be looked up.
+            if (encoding >= 0)
+            {
+                glyph.codepoint = encoding;
+                font.glyphs.push_back(glyph);
+            }
+            else
+            {
+                font.bitmaps.resize(glyph.bitmap_offset);
+            }
+
+            in_char = false;
+        }
+    }
+
+    if (rows_left > 0 || in_char)
+        parser.fail("unexpected end of file");
+
+    std::stable_sort(font.glyphs.begin(), font.glyphs.end(),
+        [] (const BitmapGlyph& lhs, const BitmapGlyph& rhs)
+        {
+            return lhs.codepoint < rhs.codepoint;
+        });
+
+    return font;
+}
+
+zest::BitmapFont zest::load_bdf(const std::string& path)
+{
+    MappedFile file(path);
+    return parse_bdf(path, std::string_view(file.data(), file.size()));
+}
+
+// Uses the binary cache when it matches the file, otherwise parses the
+// file and writes the cache for the next time.
+static zest::BitmapFont load_bdf_through_cache(const std::string& path)
+{
+    zest::MappedFile file(path);
+    uint64_t checksum = zest::fnv1a(file.data(), file.size());
+
+    std::string cache_path = zest::font_cache_path(path);
+
+    std::optional<zest::BitmapFont> font =
+        zest::read_font_cache(cache_path, file.size(), checksum);
+    if (font)
+        return std::move(*font);
+
+    zest::BitmapFont parsed =
+        parse_bdf(path, std::string_view(file.data(), file.size()));
+    zest::write_font_cache(cache_path, parsed, file.size(), checksum);
+
+    return parsed;
+}
+
+std::shared_ptr<const zest::BitmapFont>
+zest::load_bdf_cached(const std::string& path)
+{
+    static std::mutex mutex;
+    static std::unordered_map<std::string,
+                              std::shared_ptr<const BitmapFont>> fonts;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::shared_ptr<const BitmapFont>& font = fonts[path];
+    if (!font)
+        font = std::make_shared<const BitmapFont>(
+            load_bdf_through_cache(path));
+
+    return font;
+}
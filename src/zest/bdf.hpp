@@ -0,0 +1,21 @@
+#pragma once
+
+#include <zest/bitmap_font.hpp>
+
+#include <memory>
+#include <string>
+
+namespace zest
+{
+
+// Loads a font in the Glyph Bitmap Distribution Format. Only monospace
+// fonts make sense, the cell is the font bounding box. Throws
+// std::runtime_error when the file cannot be read or parsed.
+BitmapFont load_bdf(const std::string& path);
+
+// Same as load_bdf, but every file is loaded only once per process and
+// later calls share the result. The parsed font is also kept in the binary
+// font cache, so the text is only parsed again after it changes.
+std::shared_ptr<const BitmapFont> load_bdf_cached(const std::string& path);
+
+} // namespace zest
@@ -0,0 +1,50 @@
+#include "bitmap_font.hpp"
+
+#include <algorithm>
+
+
+const zest::BitmapGlyph* zest::BitmapFont::find(uint32_t codepoint) const
+{
+    auto it = std::lower_bound(glyphs.begin(), glyphs.end(), codepoint,
+        [] (const BitmapGlyph& glyph, uint32_t codepoint)
+        {
+            return glyph.codepoint < codepoint;
+        });
+
+    if (it == glyphs.end() || it->codepoint != codepoint)
+        return nullptr;
+
+    return &*it;
+}
+
+bool zest::BitmapFont::rasterize(uint32_t codepoint, GlyphCell cell) const
+{
+    const BitmapGlyph* glyph = find(codepoint);
+    if (!glyph)
+        return false;
+
+    size_t row_size = bitmap_row_size(glyph->width);
+
+    for (int y = 0; y < glyph->height; ++y)
+    {
+        int cell_y = glyph->y + y;
+        if (cell_y < 0 || cell_y >= cell.height)
+            continue;
+
+        const uint8_t* row = bitmaps.data() + glyph->bitmap_offset
+                             + y*row_size;
+        uint8_t* coverage = cell.coverage + cell_y*cell.stride;
+
+        for (int x = 0; x < glyph->width; ++x)
+        {
+            int cell_x = glyph->x + x;
+            if (cell_x < 0 || cell_x >= cell.width)
+                continue;
+
+            if (row[x/8] & (0x80 >> (x%8)))
+                coverage[cell_x] = 255;
+        }
+    }
+
+    return true;
+}
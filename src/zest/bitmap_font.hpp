@@ -0,0 +1,53 @@
+#pragma once
+
+#include <zest/glyph_atlas.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace zest
+{
+
+struct BitmapGlyph
+{
+    uint32_t codepoint;
+
+    // Box of the bitmap relative to the top left corner of the cell.
+    int16_t x;
+    int16_t y;
+    uint16_t width;
+    uint16_t height;
+
+    // Offset of the first row in BitmapFont::bitmaps. Rows are 1 bit per
+    // pixel, most significant bit first, padded to whole bytes.
+    uint32_t bitmap_offset;
+};
+
+// Monospace font made of 1-bit glyph bitmaps, so nothing needs to be
+// rasterized, only copied.
+struct BitmapFont
+{
+    int cell_width = 0;
+    int cell_height = 0;
+
+    // Distance from the top of the cell to the baseline.
+    int ascent = 0;
+
+    // Sorted by codepoint.
+    std::vector<BitmapGlyph> glyphs;
+    std::vector<uint8_t> bitmaps;
+
+    const BitmapGlyph* find(uint32_t codepoint) const;
+
+    // Copies the glyph into an atlas cell, every set bit becomes full
+    // coverage. Returns false when the font has no such glyph.
+    bool rasterize(uint32_t codepoint, GlyphCell cell) const;
+};
+
+inline size_t bitmap_row_size(int width)
+{
+    return (width + 7)/8;
+}
+
+} // namespace zest
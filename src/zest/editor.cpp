@@ -0,0 +1,1613 @@
+#include "editor.hpp"
+
+#include <zest/bdf.hpp>
+#include <zest/profile.hpp>
+#include <zest/highlight/captures.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cmath>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+
+// Atlas cells come straight from the bitmap fonts. When the bold font has
+// no glyph, the regular one is made bold by smearing it one pixel to the
+// right.
+static zest::GlyphRasterizer make_font_rasterizer(const FontInfo& font_info)
+{
+    return [regular = font_info.regular, bold = font_info.bold]
+           (uint32_t codepoint, zest::GlyphStyle style, zest::GlyphCell cell)
+    {
+        if (style == zest::GlyphStyle::bold && bold
+            && bold->rasterize(codepoint, cell))
+        {
+            return true;
+        }
+
+        if (!regular->rasterize(codepoint, cell))
+            return false;
+
+        if (style == zest::GlyphStyle::bold)
+        {
+            for (int y = 0; y < cell.height; ++y)
+            {
+                uint8_t* row = cell.coverage + y*cell.stride;
+                for (int x = cell.width - 1; x > 0; --x)
+                    row[x] = std::max(row[x], row[x - 1]);
+            }
+        }
+
+        return true;
+    };
+}
+
+static bool is_continuation(char byte)
+{
+    return (uint8_t(byte) & 0xc0) == 0x80;
+}
+
+// Backs the column up to the start of the codepoint it falls into, so a
+// cursor never sits inside a character.
+static int codepoint_start(std::string_view line, int col)
+{
+    while (col > 0 && size_t(col) < line.size() && is_continuation(line[col]))
+        col--;
+    return col;
+}
+
+static int previous_codepoint(std::string_view line, int col)
+{
+    return codepoint_start(line, col - 1);
+}
+
+static int next_codepoint(std::string_view line, int col)
+{
+    col++;
+    while (size_t(col) < line.size() && is_continuation(line[col]))
+        col++;
+    return col;
+}
+
+static zest::CellPos window_to_cursor_pos(Editor& editor,
+                                          LineBuffer& line_buffer,
+                                          zest::Vec2 pos)
+{
+    pos.x += editor.file_space_x - editor.top_left_x;
+    pos.y += editor.file_space_y - editor.top_left_y;
+
+    int col = std::round(pos.x/editor.cell_width);
+    int row = pos.y/editor.cell_height;
+
+    if (size_t(row) >= line_buffer.line_count())
+        row = line_buffer.line_count() - 1;
+
+    std::string_view line = line_buffer.get_line(row);
+    if (size_t(col) > line.size())
+        col = line.size();
+
+    return { row, codepoint_start(line, col) };
+}
+
+static bool move_cursor_up(CursorState& cursor,
+                           const LineBuffer& line_buffer)
+{
+    if (cursor.line == 0)
+        return false;
+
+    cursor.line--;
+    std::string_view line = line_buffer.get_line(cursor.line);
+    cursor.col = codepoint_start(line,
+                                 std::min((size_t)cursor.original_col,
+                                          line.size()));
+
+    return true;
+}
+
+static bool move_cursor_down(CursorState& cursor,
+                             const LineBuffer& line_buffer)
+{
+    if (size_t(cursor.line) + 1 >= line_buffer.line_count())
+        return false;
+
+    cursor.line++;
+    std::string_view line = line_buffer.get_line(cursor.line);
+    cursor.col = codepoint_start(line,
+                                 std::min((size_t)cursor.original_col,
+                                          line.size()));
+
+    return true;
+}
+
+static bool move_cursor_left(CursorState& cursor,
+                             const LineBuffer& line_buffer)
+{
+    if (cursor.col == 0)
+    {
+        bool has_moved = move_cursor_up(cursor, line_buffer);
+        if (has_moved)
+        {
+            cursor.col = line_buffer.get_line(cursor.line).size();
+            cursor.original_col = cursor.col;
+        }
+        return has_moved;
+    }
+
+    cursor.col = previous_codepoint(line_buffer.get_line(cursor.line),
+                                    cursor.col);
+    cursor.original_col = cursor.col;
+
+    return true;
+}
+
+static bool move_cursor_right(CursorState& cursor,
+                              const LineBuffer& line_buffer)
+{
+    std::string_view line = line_buffer.get_line(cursor.line);
+    if (size_t(cursor.col) == line.size())
+    {
+        bool has_moved = move_cursor_down(cursor, line_buffer);
+        if (has_moved)
+        {
+            cursor.col = 0;
+            cursor.original_col = cursor.col;
+        }
+        return has_moved;
+    }
+
+    cursor.col = next_codepoint(line, cursor.col);
+    cursor.original_col = cursor.col;
+
+    return true;
+}
+
+static void stop_cursor(CursorState& cursor)
+{
+    cursor.state_down.active = false;
+    cursor.state_up.active = false;
+    cursor.state_right.active = false;
+    cursor.state_left.active = false;
+    cursor.state_backspace.active = false;
+    cursor.state_delete.active = false;
+    cursor.state_enter.active = false;
+}
+
+static void set_cursor(CursorState& cursor, zest::CellPos pos)
+{
+    cursor.line = pos.line;
+    cursor.col = pos.col;
+    cursor.original_col = cursor.col;
+}
+
+// Every change of the buffer has to go through here so that the syntax
+// tree stays in sync with the text.
+static void apply_edit(Editor& editor, const zest::TextEdit& edit)
+{
+    if (editor.tree)
+        zest::tree_sitter::edit_tree(editor.tree.get(), edit);
+    editor.edit_log.push_back(edit);
+    editor.tree_dirty = true;
+
+    editor.highlight_cache.apply_edit(edit);
+
+    // The lines below the edit only move when it changed the line count.
+    if (edit.old_end.line == edit.new_end.line)
+        editor.damage.mark(edit.start.line, edit.new_end.line + 1);
+    else
+        editor.damage.mark(edit.start.line, INT_MAX);
+
+    editor.selection_valid = false;
+}
+
+// Keeps the search matches in step with edits just made to the text. The
+// matches around each edit are dropped and searched for again, those of a
+// literal up to its length before it, those of a regex on its whole lines,
+// all the others only move.
+static void edit_matches(const LineBuffer& line_buffer, Editor& editor,
+                         const std::vector<zest::TextEdit>& edits)
+{
+    SearchState& search = editor.search;
+    if (search.query.empty() || !search.error.empty() || search.dirty)
+        return;
+
+    // Searches that fall this far behind the text start over instead.
+    constexpr size_t max_pending_edits = 4096;
+
+    // Every edit as the range of the text to search again, the ones close
+    // enough together as one. Old offsets are from before the edits, new
+    // ones from after all of them.
+    std::vector<zest::ByteEdit> regions;
+    std::vector<zest::ByteRange> rescans;
+
+    size_t pattern_size = search.query.size();
+    ptrdiff_t shift = 0;
+    for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit)
+    {
+        size_t from;
+        size_t new_to;
+        if (search.compiled)
+        {
+            from = edit->start_byte - edit->start.col;
+
+            size_t line = line_buffer.position_of(edit->new_end_byte + shift)
+                              .line;
+            new_to = line + 1 < line_buffer.line_count()
+                         ? line_buffer.offset_of({ int(line) + 1, 0 })
+                         : line_buffer.size();
+        }
+        else
+        {
+            from = edit->start_byte
+                   - std::min(edit->start_byte, pattern_size - 1);
+            new_to = edit->new_end_byte + shift;
+        }
+
+        size_t new_from = from + shift;
+        shift += ptrdiff_t(edit->new_end_byte - edit->old_end_byte);
+        size_t old_to = new_to - shift;
+
+        if (!regions.empty() && from < regions.back().old_end)
+        {
+            regions.back().old_end = old_to;
+            regions.back().new_end = regions.back().start
+                                     + (new_to - rescans.back().start);
+            rescans.back().end = new_to;
+        }
+        else
+        {
+            regions.push_back({ from, old_to, from + (new_to - new_from) });
+            rescans.push_back({ new_from, new_to });
+        }
+    }
+
+    search.matches.apply_edits(regions);
+
+    if (search.search)
+    {
+        search.pending_edits.push_back(regions);
+        if (search.pending_edits.size() > max_pending_edits)
+            search.dirty = true;
+    }
+
+    std::vector<zest::ByteRange> found;
+    for (zest::ByteRange rescan : rescans)
+    {
+        if (search.compiled)
+            zest::find_regex(line_buffer, search.compiled,
+                             rescan.start, rescan.end, found);
+        else
+            zest::find_literal(line_buffer, search.query,
+                               rescan.start, rescan.end, found);
+    }
+
+    search.matches.insert(found);
+    search.version++;
+}
+
+// Edits made to the text together, sorted by their start, last first,
+// with all positions from before any of them. The tree and the cache take
+// them in a single pass, the lines below only move once.
+static void apply_edits(const LineBuffer& line_buffer, Editor& editor,
+                        const std::vector<zest::TextEdit>& edits)
+{
+    edit_matches(line_buffer, editor, edits);
+
+    if (edits.size() <= 1)
+    {
+        if (!edits.empty())
+            apply_edit(editor, edits.front());
+        return;
+    }
+
+    bool lines_moved = false;
+    for (const zest::TextEdit& edit : edits)
+    {
+        if (editor.tree)
+            zest::tree_sitter::edit_tree(editor.tree.get(), edit);
+        editor.edit_log.push_back(edit);
+
+        lines_moved |= edit.old_end.line != edit.new_end.line;
+    }
+    editor.tree_dirty = true;
+
+    editor.highlight_cache.apply_edits(edits);
+
+    if (lines_moved)
+    {
+        editor.damage.mark(edits.back().start.line, INT_MAX);
+    }
+    else
+    {
+        for (const zest::TextEdit& edit : edits)
+            editor.damage.mark(edit.start.line, edit.new_end.line + 1);
+    }
+
+    editor.selection_valid = false;
+}
+
+// Copies length bytes of the text from offset on.
+static std::string text_at(const LineBuffer& line_buffer, size_t offset,
+                           size_t length)
+{
+    std::string text;
+    while (text.size() < length)
+    {
+        std::string_view chunk = line_buffer.chunk_at(offset + text.size());
+        if (chunk.empty())
+            break;
+        text.append(chunk.substr(0, length - text.size()));
+    }
+
+    return text;
+}
+
+// Makes the replacements, sorted and not overlapping, with offsets into
+// the text before any of them, as a single change of the text. Returns
+// where each of them ends afterwards.
+static std::vector<zest::CellPos> replace(
+    LineBuffer& line_buffer, Editor& editor,
+    const std::vector<TextReplacement>& batch, bool record)
+{
+    // Every replacement as an edit, the ones that change nothing as an
+    // empty one where they are.
+    std::vector<zest::TextEdit> batch_edits(batch.size());
+
+    std::vector<TextReplacement> changes;
+    changes.reserve(batch.size());
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        const TextReplacement& replacement = batch[i];
+        if (replacement.start != replacement.end
+            || !replacement.text.empty())
+        {
+            changes.push_back(replacement);
+            continue;
+        }
+
+        zest::TextEdit& edit = batch_edits[i];
+        edit.start_byte = edit.old_end_byte = edit.new_end_byte =
+            replacement.start;
+        edit.start = edit.old_end = edit.new_end =
+            line_buffer.position_of(replacement.start);
+    }
+
+    // The history takes the operations along with the bytes they deleted.
+    std::string deleted;
+    std::vector<size_t> deleted_ends;
+    if (record)
+    {
+        for (const TextReplacement& change : changes)
+        {
+            deleted += text_at(line_buffer, change.start,
+                               change.end - change.start);
+            deleted_ends.push_back(deleted.size());
+        }
+    }
+
+    std::vector<zest::TextEdit> edits = line_buffer.replace(changes);
+    apply_edits(line_buffer, editor, edits);
+
+    if (record && changes.size() == 1)
+    {
+        const TextReplacement& change = changes.front();
+        editor.history.record(change.start, deleted, change.text);
+    }
+    else if (record && !changes.empty())
+    {
+        std::vector<zest::EditOp> ops;
+        ops.reserve(changes.size());
+
+        size_t deleted_start = 0;
+        for (size_t i = 0; i < changes.size(); ++i)
+        {
+            const TextReplacement& change = changes[i];
+            std::string_view bytes =
+                std::string_view(deleted).substr(
+                    deleted_start, deleted_ends[i] - deleted_start);
+            ops.push_back({ change.start, bytes, change.text });
+            deleted_start = deleted_ends[i];
+        }
+
+        editor.history.record_batch(ops);
+    }
+
+    auto edit = edits.rbegin();
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        if (batch[i].start != batch[i].end || !batch[i].text.empty())
+            batch_edits[i] = *edit++;
+    }
+
+    // The edits before a replacement move its end down by the lines they
+    // added, and along its line when the last of them ended on the line it
+    // starts on, so a single sweep finds all of them.
+    std::vector<zest::CellPos> ends;
+    ends.reserve(batch.size());
+
+    int line_shift = 0;
+    int shifted_line = -1;
+    int col_shift = 0;
+    for (const zest::TextEdit& batch_edit : batch_edits)
+    {
+        zest::CellPos end = batch_edit.new_end;
+        if (batch_edit.start.line == shifted_line
+            && batch_edit.new_end.line == batch_edit.start.line)
+        {
+            end.col += col_shift;
+        }
+        end.line += line_shift;
+        ends.push_back(end);
+
+        line_shift += batch_edit.new_end.line - batch_edit.old_end.line;
+        shifted_line = batch_edit.old_end.line;
+        col_shift = end.col - batch_edit.old_end.col;
+    }
+
+    return ends;
+}
+
+// Text the main cursor edits: the selection, or just where it is.
+static std::pair<zest::CellPos, zest::CellPos>
+main_cursor_range(const CursorState& cursor, const Editor& editor)
+{
+    auto [start, end] = selection_range(editor);
+    if (editor.selection_valid && start != end)
+        return { start, end };
+
+    return { { cursor.line, cursor.col }, { cursor.line, cursor.col } };
+}
+
+// Whether the second range, which does not start before the first, shares
+// text with it or takes the same place. Ranges that only touch are fine
+// unless one of them is empty, the cursors would end up together.
+static bool overlap(std::pair<zest::CellPos, zest::CellPos> first,
+                    std::pair<zest::CellPos, zest::CellPos> second)
+{
+    return second.first < first.second || second.first == first.first
+           || (second.first == first.second
+               && (first.first == first.second
+                   || second.first == second.second));
+}
+
+// Sorts the extra cursors and drops the ones overlapping another cursor.
+static void normalize_cursors(const CursorState& cursor, Editor& editor)
+{
+    std::vector<ExtraCursor>& extras = editor.extra_cursors;
+
+    std::sort(extras.begin(), extras.end(),
+              [] (const ExtraCursor& lhs, const ExtraCursor& rhs)
+              {
+                  return lhs.start() < rhs.start()
+                         || (lhs.start() == rhs.start()
+                             && lhs.end() < rhs.end());
+              });
+
+    auto range = [] (const ExtraCursor& extra)
+    {
+        return std::make_pair(extra.start(), extra.end());
+    };
+
+    auto main = main_cursor_range(cursor, editor);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < extras.size(); ++i)
+    {
+        auto current = range(extras[i]);
+
+        if (kept > 0 && overlap(range(extras[kept - 1]), current))
+            continue;
+        if (current.first < main.first ? overlap(current, main)
+                                        : overlap(main, current))
+        {
+            continue;
+        }
+
+        extras[kept++] = extras[i];
+    }
+    extras.resize(kept);
+
+    editor.cursors_version++;
+}
+
+enum class CursorEdit
+{
+    insert,
+    erase_before,
+    erase_after,
+};
+
+// Applies one keystroke at every cursor as a single change of the text.
+// Text replaces the selections, erasing takes just them when there are
+// any. Returns whether the text changed.
+static bool edit_at_cursors(CursorState& cursor,
+                            Editor& editor,
+                            LineBuffer& line_buffer,
+                            CursorEdit kind,
+                            std::string_view text = {})
+{
+    std::vector<ExtraCursor>& extras = editor.extra_cursors;
+
+    auto main = main_cursor_range(cursor, editor);
+    size_t main_index = std::partition_point(
+        extras.begin(), extras.end(),
+        [&] (const ExtraCursor& extra) { return extra.start() < main.first; }
+    ) - extras.begin();
+
+    std::vector<TextReplacement> batch;
+    batch.reserve(extras.size() + 1);
+
+    bool changed = false;
+    for (size_t i = 0; i <= extras.size(); ++i)
+    {
+        auto [start_pos, end_pos] =
+            i < main_index    ? std::make_pair(extras[i].start(),
+                                               extras[i].end())
+            : i == main_index ? main
+                              : std::make_pair(extras[i - 1].start(),
+                                               extras[i - 1].end());
+
+        size_t start = line_buffer.offset_of(start_pos);
+        size_t end = start_pos == end_pos ? start
+                                          : line_buffer.offset_of(end_pos);
+
+        // Erasing takes a whole codepoint, or the line break at the edge
+        // of the line.
+        if (kind == CursorEdit::erase_before && start == end && start > 0)
+        {
+            int col = start_pos.col;
+            start -= col > 0
+                ? col - previous_codepoint(
+                      line_buffer.get_line(start_pos.line), col)
+                : 1;
+        }
+        else if (kind == CursorEdit::erase_after && start == end
+                 && end < line_buffer.size())
+        {
+            std::string_view line = line_buffer.get_line(start_pos.line);
+            int col = start_pos.col;
+            end += size_t(col) < line.size()
+                ? next_codepoint(line, col) - col
+                : 1;
+        }
+
+        if (!batch.empty())
+            start = std::max(start, batch.back().end);
+        end = std::max(start, end);
+
+        std::string_view inserted =
+            kind == CursorEdit::insert ? text : std::string_view();
+        changed |= start != end || !inserted.empty();
+        batch.push_back({ start, end, inserted });
+    }
+
+    if (!changed)
+        return false;
+
+    std::vector<zest::CellPos> ends =
+        replace(line_buffer, editor, batch, true);
+
+    set_cursor(cursor, ends[main_index]);
+
+    if (!extras.empty())
+    {
+        for (size_t i = 0; i < extras.size(); ++i)
+        {
+            zest::CellPos end = ends[i < main_index ? i : i + 1];
+            extras[i] = { end, end };
+        }
+
+        normalize_cursors(cursor, editor);
+    }
+
+    return true;
+}
+
+// Applies operations taken from the history, without recording them
+// again, and puts a cursor after each of them, the main one after the
+// last.
+static void apply_history(LineBuffer& line_buffer,
+                          CursorState& cursor,
+                          Editor& editor,
+                          const std::vector<zest::EditOp>& ops)
+{
+    if (ops.empty())
+        return;
+
+    std::vector<TextReplacement> batch;
+    batch.reserve(ops.size());
+    for (const zest::EditOp& op : ops)
+        batch.push_back({ op.offset, op.offset + op.deleted.size(),
+                          op.inserted });
+
+    std::vector<zest::CellPos> ends =
+        replace(line_buffer, editor, batch, false);
+
+    set_cursor(cursor, ends.back());
+
+    editor.extra_cursors.clear();
+    for (size_t i = 0; i + 1 < ends.size(); ++i)
+        editor.extra_cursors.push_back({ ends[i], ends[i] });
+    normalize_cursors(cursor, editor);
+
+    cursor.time = 0;
+    cursor.visible = true;
+    editor.cursorize_view = true;
+}
+
+// Makes a move of the main cursor move the extra ones as well, which
+// lose their selections.
+template<typename MoveFunc>
+static auto move_all_cursors(Editor& editor, MoveFunc move)
+{
+    return [&editor, move] (CursorState& cursor,
+                            const LineBuffer& line_buffer)
+    {
+        bool has_moved = move(cursor, line_buffer);
+        if (editor.extra_cursors.empty())
+            return has_moved;
+
+        CursorState extra_cursor;
+        for (ExtraCursor& extra : editor.extra_cursors)
+        {
+            set_cursor(extra_cursor, extra.pos);
+            has_moved |= move(extra_cursor, line_buffer);
+
+            extra.pos = { extra_cursor.line, extra_cursor.col };
+            extra.anchor = extra.pos;
+        }
+
+        normalize_cursors(cursor, editor);
+
+        return has_moved;
+    };
+}
+
+template<typename MoveFunc>
+static void update_cursor_direction(LineBuffer& line_buffer,
+                                    CursorState& cursor,
+                                    Editor& editor,
+                                    MoveFunc move,
+                                    const zest::InputState::KeyState& key,
+                                    CursorState::MoveState& state,
+                                    double time_delta)
+{
+    auto move_cursor = [&] ()
+    {
+        bool has_moved = move(cursor, line_buffer);
+        if (has_moved)
+        {
+            cursor.time = 0;
+            cursor.visible = true;
+        }
+    };
+
+    if (key.pressed)
+    {
+        stop_cursor(cursor);
+        move_cursor();
+        state.down_time = cursor.move_rate - cursor.initial_delay;
+        state.active = true;
+
+        editor.cursorize_view = true;
+    }
+    else if (key.down && state.active)
+    {
+        state.down_time += time_delta;
+        if (state.down_time >= cursor.move_rate)
+        {
+            move_cursor();
+            state.down_time -= cursor.move_rate;
+        }
+
+        editor.cursorize_view = true;
+    }
+}
+
+static void update_text_input(LineBuffer& line_buffer,
+                              CursorState& cursor,
+                              Editor& editor,
+                              const std::string& text)
+{
+    if (text.empty())
+        return;
+
+    edit_at_cursors(cursor, editor, line_buffer, CursorEdit::insert, text);
+
+    cursor.time = 0;
+    cursor.visible = true;
+    editor.cursorize_view = true;
+}
+
+static void set_cursor_to_mouse(CursorState& cursor,
+                                Editor& editor,
+                                LineBuffer& line_buffer,
+                                zest::Vec2 mouse_pos)
+{
+    if (!zest::is_inside(mouse_pos, editor.text_area_rect))
+        return;
+
+    zest::CellPos cell_pos = window_to_cursor_pos(editor, line_buffer,
+                                                  mouse_pos);
+
+    cursor.col = cell_pos.col;
+    cursor.original_col = cursor.col;
+    cursor.line = cell_pos.line;
+
+    cursor.visible = true;
+    cursor.time = 0;
+
+    if (!editor.extra_cursors.empty())
+    {
+        editor.extra_cursors.clear();
+        editor.cursors_version++;
+    }
+}
+
+static void add_cursor_at_mouse(const CursorState& cursor,
+                                Editor& editor,
+                                LineBuffer& line_buffer,
+                                zest::Vec2 mouse_pos)
+{
+    if (!zest::is_inside(mouse_pos, editor.text_area_rect))
+        return;
+
+    zest::CellPos pos = window_to_cursor_pos(editor, line_buffer,
+                                             mouse_pos);
+    editor.extra_cursors.push_back({ pos, pos });
+    normalize_cursors(cursor, editor);
+}
+
+static void set_file_view_to_cursor(CursorState& cursor, Editor& editor)
+{
+    zest::Rect cursor_cell = {
+        float(cursor.col*editor.font_info.char_step),
+        float(cursor.line*editor.font_info.font_size),
+        editor.font_info.char_step,
+        float(editor.font_info.font_size)
+    };
+
+    if (zest::get_top(cursor_cell) < editor.file_space_y)
+        editor.file_space_y = cursor_cell.y;
+
+    if (zest::get_bot(cursor_cell) > editor.file_space_y + editor.height)
+        editor.file_space_y = zest::get_bot(cursor_cell) - editor.height;
+
+    if (zest::get_left(cursor_cell) < editor.file_space_x)
+        editor.file_space_x = zest::get_left(cursor_cell);
+
+    if (zest::get_right(cursor_cell) > editor.file_space_x + editor.width)
+        editor.file_space_x = zest::get_right(cursor_cell) - editor.width;
+
+    editor.view_rect.x = editor.file_space_x;
+    editor.view_rect.y = editor.file_space_y;
+}
+
+static void update_selection(Editor& editor, LineBuffer& line_buffer,
+                             const zest::InputState& input)
+{
+    zest::Vec2 mouse_pos = input.mouse_pos;
+
+    if (is_inside(mouse_pos, editor.text_area_rect) && input.mouse_pressed)
+    {
+        editor.selecting = true;
+        editor.selection_valid = true;
+        editor.selection_origin =
+            window_to_cursor_pos(editor, line_buffer, mouse_pos);
+        editor.selection_current = editor.selection_origin;
+    }
+
+    if (editor.selecting)
+    {
+        if (input.mouse_down)
+            editor.selection_current =
+                window_to_cursor_pos(editor, line_buffer, mouse_pos);
+
+        if (input.mouse_released)
+            editor.selecting = false;
+    }
+}
+
+// Moves the cursor to the first match after it, or back to the first one
+// in the text.
+static void jump_to_next_match(LineBuffer& line_buffer,
+                               CursorState& cursor,
+                               Editor& editor)
+{
+    const zest::MatchList& matches = editor.search.matches;
+    if (matches.empty())
+        return;
+
+    size_t offset = line_buffer.offset_of({ cursor.line, cursor.col });
+    std::optional<zest::ByteRange> match = matches.first_from(offset + 1);
+    if (!match)
+        match = matches.first_from(0);
+
+    set_cursor(cursor, line_buffer.position_of(match->start));
+    cursor.time = 0;
+    cursor.visible = true;
+    editor.cursorize_view = true;
+}
+
+static void erase_last_codepoint(std::string& text)
+{
+    while (!text.empty() && is_continuation(text.back()))
+        text.pop_back();
+
+    if (!text.empty())
+        text.pop_back();
+}
+
+static void close_search_bar(Editor& editor)
+{
+    SearchState& search = editor.search;
+    if (!search.matches.empty())
+        editor.damage.mark_all();
+
+    uint64_t version = search.version;
+    search = SearchState();
+    search.version = version + 1;
+}
+
+// Puts the main cursor on the first match found so far and an extra one
+// on each of the others, all with their match selected.
+static void select_all_matches(LineBuffer& line_buffer,
+                               CursorState& cursor,
+                               Editor& editor)
+{
+    std::vector<zest::ByteRange> matches;
+    editor.search.matches.find(0, SIZE_MAX, matches);
+    if (matches.empty())
+        return;
+
+    editor.extra_cursors.clear();
+    editor.extra_cursors.reserve(matches.size() - 1);
+    for (size_t i = 1; i < matches.size(); ++i)
+    {
+        editor.extra_cursors.push_back(
+            { line_buffer.position_of(matches[i].end),
+              line_buffer.position_of(matches[i].start) });
+    }
+
+    set_cursor(cursor, line_buffer.position_of(matches[0].end));
+    editor.selecting = false;
+    editor.selection_valid = true;
+    editor.selection_origin = line_buffer.position_of(matches[0].start);
+    editor.selection_current = { cursor.line, cursor.col };
+
+    normalize_cursors(cursor, editor);
+
+    cursor.time = 0;
+    cursor.visible = true;
+    editor.cursorize_view = true;
+}
+
+// Takes the input meant for the search bar while it is open. Returns the
+// rest of it, which goes to the text as usual.
+static zest::InputState update_search_bar(LineBuffer& line_buffer,
+                                          CursorState& cursor,
+                                          Editor& editor,
+                                          const zest::InputState& input)
+{
+    using Command = zest::InputState::Command;
+    using Key = zest::InputState::Key;
+
+    SearchState& search = editor.search;
+
+    if (input.command(Command::find) && !search.active)
+    {
+        search.active = true;
+        search.version++;
+    }
+
+    if (input.command(Command::toggle_regex) && search.active)
+    {
+        search.regex = !search.regex;
+        search.dirty = true;
+    }
+
+    if (!search.active)
+    {
+        if (input.command(Command::find_next))
+            jump_to_next_match(line_buffer, cursor, editor);
+        return input;
+    }
+
+    zest::InputState rest = input;
+    rest.text.clear();
+    rest.key(Key::backspace) = {};
+    rest.key(Key::enter) = {};
+    rest.command(Command::cancel) = false;
+
+    if (input.command(Command::select_all_matches))
+    {
+        select_all_matches(line_buffer, cursor, editor);
+        close_search_bar(editor);
+        return rest;
+    }
+
+    if (input.command(Command::cancel))
+    {
+        close_search_bar(editor);
+        return rest;
+    }
+
+    if (!input.text.empty())
+    {
+        search.query += input.text;
+        search.dirty = true;
+    }
+
+    if (input.key(Key::backspace).pressed && !search.query.empty())
+    {
+        erase_last_codepoint(search.query);
+        search.dirty = true;
+    }
+
+    if (input.key(Key::enter).pressed || input.command(Command::find_next))
+        jump_to_next_match(line_buffer, cursor, editor);
+
+    return rest;
+}
+
+// Restarts the search when its query changed, or when the text changed
+// too much while it ran, and takes the matches found since the last
+// frame. The blocks around the view are searched first, so the matches
+// there show up long before the whole text is done.
+static void update_search(LineBuffer& line_buffer, Editor& editor)
+{
+    SearchState& search = editor.search;
+
+    int first_row, last_row;
+    visible_rows(editor, first_row, last_row);
+
+    int line_count = line_buffer.line_count();
+    first_row = std::min(first_row, line_count - 1);
+    last_row = std::min(last_row, line_count - 1);
+
+    if (search.dirty)
+    {
+        search.search.reset();
+        if (!search.matches.empty())
+            editor.damage.mark_all();
+        search.matches = zest::MatchList();
+        search.compiled.reset();
+        search.pending_edits.clear();
+        search.error.clear();
+
+        size_t view_offset = line_buffer.offset_of({ first_row, 0 });
+        if (!search.query.empty() && search.regex)
+        {
+            try
+            {
+                search.compiled = zest::regex::compile_cached(search.query);
+                search.search = std::make_unique<zest::Search>(
+                    line_buffer.snapshot(), search.compiled, view_offset);
+            }
+            catch (const std::runtime_error& e)
+            {
+                search.error = e.what();
+            }
+        }
+        else if (!search.query.empty())
+        {
+            search.search = std::make_unique<zest::Search>(
+                line_buffer.snapshot(), search.query, view_offset);
+        }
+
+        search.dirty = false;
+        search.version++;
+    }
+
+    if (!search.search)
+        return;
+
+    bool done = search.search->done();
+    std::vector<std::vector<zest::ByteRange>> blocks =
+        search.search->take_matches();
+
+    size_t view_start = line_buffer.offset_of({ first_row, 0 });
+    size_t view_end = last_row + 1 < line_count
+                          ? line_buffer.offset_of({ last_row + 1, 0 })
+                          : line_buffer.size();
+
+    // Each block is merged in on its own, the matches of the others stay
+    // where they are.
+    for (std::vector<zest::ByteRange>& block : blocks)
+    {
+        for (const std::vector<zest::ByteEdit>& edits : search.pending_edits)
+            zest::update_matches(block, edits);
+
+        for (zest::ByteRange match : block)
+        {
+            if (match.start >= view_start && match.start < view_end)
+                editor.damage.mark(line_buffer.position_of(match.start).line);
+        }
+
+        search.matches.insert(block);
+        search.version++;
+    }
+
+    // Everything was taken, the workers can go.
+    if (done)
+    {
+        search.search.reset();
+        search.pending_edits.clear();
+        search.version++;
+    }
+}
+
+
+void update(LineBuffer& line_buffer, CursorState& cursor, Editor& editor,
+            const zest::InputState& all_input, double time_delta)
+{
+    using Key = zest::InputState::Key;
+
+    zest::InputState input =
+        update_search_bar(line_buffer, cursor, editor, all_input);
+
+    using Command = zest::InputState::Command;
+
+    if (input.command(Command::undo))
+        apply_history(line_buffer, cursor, editor, editor.history.undo());
+    if (input.command(Command::redo))
+        apply_history(line_buffer, cursor, editor, editor.history.redo());
+
+    // Typing somewhere else starts a new undo step.
+    if (input.key(Key::left).pressed || input.key(Key::right).pressed
+        || input.key(Key::up).pressed || input.key(Key::down).pressed
+        || input.mouse_pressed)
+    {
+        editor.history.seal();
+    }
+
+    if (input.command(Command::cancel) && !editor.extra_cursors.empty())
+    {
+        editor.extra_cursors.clear();
+        editor.cursors_version++;
+    }
+
+    update_cursor_direction(line_buffer, cursor, editor,
+                            move_all_cursors(editor, move_cursor_left),
+                            input.key(Key::left), cursor.state_left,
+                            time_delta);
+    update_cursor_direction(line_buffer, cursor, editor,
+                            move_all_cursors(editor, move_cursor_right),
+                            input.key(Key::right), cursor.state_right,
+                            time_delta);
+    update_cursor_direction(line_buffer, cursor, editor,
+                            move_all_cursors(editor, move_cursor_up),
+                            input.key(Key::up), cursor.state_up,
+                            time_delta);
+    update_cursor_direction(line_buffer, cursor, editor,
+                            move_all_cursors(editor, move_cursor_down),
+                            input.key(Key::down), cursor.state_down,
+                            time_delta);
+
+    update_cursor_direction(
+        line_buffer, cursor, editor,
+        [&] (CursorState& cursor, LineBuffer& line_buffer)
+        {
+            return edit_at_cursors(cursor, editor, line_buffer,
+                                   CursorEdit::erase_before);
+        },
+        input.key(Key::backspace), cursor.state_backspace, time_delta);
+    update_cursor_direction(
+        line_buffer, cursor, editor,
+        [&] (CursorState& cursor, LineBuffer& line_buffer)
+        {
+            return edit_at_cursors(cursor, editor, line_buffer,
+                                   CursorEdit::erase_after);
+        },
+        input.key(Key::del), cursor.state_delete, time_delta);
+    update_cursor_direction(
+        line_buffer, cursor, editor,
+        [&] (CursorState& cursor, LineBuffer& line_buffer)
+        {
+            return edit_at_cursors(cursor, editor, line_buffer,
+                                   CursorEdit::insert, "\n");
+        },
+        input.key(Key::enter), cursor.state_enter, time_delta);
+
+    update_text_input(line_buffer, cursor, editor, input.text);
+
+    if (editor.cursorize_view)
+        set_file_view_to_cursor(cursor, editor);
+    editor.cursorize_view = false;
+
+    if (input.mouse_adds_cursor)
+    {
+        if (input.mouse_pressed)
+            add_cursor_at_mouse(cursor, editor, line_buffer,
+                                input.mouse_pos);
+    }
+    else if (input.mouse_pressed || input.mouse_down)
+    {
+        set_cursor_to_mouse(cursor, editor, line_buffer, input.mouse_pos);
+    }
+
+    cursor.time += time_delta;
+    if (cursor.time >= cursor.blink_time)
+    {
+        cursor.time -= cursor.blink_time;
+        cursor.visible = !cursor.visible;
+    }
+
+    // Whole pixels only, so that every line covers the same image rows
+    // until the view moves again.
+    editor.file_space_y += std::round(-input.wheel*editor.cell_height);
+    editor.view_rect.y = editor.file_space_y;
+
+    if (editor.file_space_y < 0)
+        editor.file_space_y = 0;
+
+    float file_bot = (line_buffer.line_count() - 1) * editor.cell_height;
+    if (editor.file_space_y >= file_bot)
+        editor.file_space_y = file_bot;
+
+    if (!input.mouse_adds_cursor)
+        update_selection(editor, line_buffer, input);
+
+    update_search(line_buffer, editor);
+}
+
+
+
+zest::Surface text_area_surface(Editor& editor)
+{
+    return { editor.text_area_pixels.data(), editor.width, editor.height,
+             size_t(editor.width)*4 };
+}
+
+static void draw_rectangle(Editor& editor, const zest::Rect& rect,
+                           zest::Color color)
+{
+    zest::Surface surface = text_area_surface(editor);
+    zest::fill_rect(surface, std::floor(rect.x), std::floor(rect.y),
+                    rect.width, rect.height, color);
+}
+
+// Draws the bytes [from, to) of the line, one cell per codepoint.
+static void draw_text_segment(Editor& editor,
+                              std::string_view line,
+                              int from, int to,
+                              zest::Vec2 pos,
+                              zest::Color text_color,
+                              std::optional<zest::Color> bg_color)
+{
+    to = std::min<int>(to, line.size());
+    if (from >= to)
+        return;
+
+    int n = to - from;
+
+    if (bg_color)
+        draw_rectangle(editor,
+                       { pos.x, pos.y,
+                         n*editor.cell_width, editor.cell_height },
+                       *bg_color);
+
+    zest::Surface surface = text_area_surface(editor);
+    editor.glyph_atlas->draw_text(surface,
+                                  std::floor(pos.x), std::floor(pos.y),
+                                  line.substr(from, n),
+                                  text_color);
+}
+
+
+void update_syntax_tree(Editor& editor, const LineBuffer& line_buff)
+{
+    if (editor.tree_dirty)
+    {
+        uint64_t version = editor.edit_log_base + editor.edit_log.size();
+        std::vector<zest::TextEdit> edits(
+            editor.edit_log.begin()
+                + (editor.submitted_edits - editor.edit_log_base),
+            editor.edit_log.end());
+
+        editor.parse_worker->submit(line_buff.snapshot(),
+                                    std::move(edits),
+                                    version);
+        editor.submitted_edits = version;
+        editor.tree_dirty = false;
+    }
+
+    std::optional<zest::tree_sitter::ParseResult> result =
+        editor.parse_worker->take_result();
+    if (!result)
+        return;
+
+    // Bring the new tree up to date with the edits made while it was being
+    // parsed.
+    size_t parsed = result->version - editor.edit_log_base;
+    for (size_t i = parsed; i < editor.edit_log.size(); ++i)
+        zest::tree_sitter::edit_tree(result->tree.get(), editor.edit_log[i]);
+
+    editor.edit_log.erase(editor.edit_log.begin(),
+                          editor.edit_log.begin() + parsed);
+    editor.edit_log_base = result->version;
+
+    editor.highlight_cache.invalidate_changes(editor.tree.get(),
+                                              result->tree.get());
+    editor.tree = std::move(result->tree);
+}
+
+std::pair<zest::CellPos, zest::CellPos> selection_range(const Editor& editor)
+{
+    zest::CellPos selection_start = editor.selection_origin;
+    zest::CellPos selection_end = editor.selection_current;
+    if (editor.selection_origin.line > editor.selection_current.line
+        || (editor.selection_origin.line == editor.selection_current.line
+            && editor.selection_origin.col >= editor.selection_current.col))
+    {
+        std::swap(selection_start, selection_end);
+    }
+
+    return { selection_start, selection_end };
+}
+
+void update_damage(CursorState& cursor, Editor& editor,
+                   int first_row, int last_row)
+{
+    zest::LineDamage& damage = editor.damage;
+    Editor::DrawnState& drawn = editor.drawn;
+
+    damage.set_view(first_row, last_row - first_row + 1);
+    if (editor.file_space_x != drawn.file_space_x
+        || editor.file_space_y != drawn.file_space_y)
+    {
+        damage.mark_all();
+    }
+
+    if (cursor.line != drawn.cursor_line
+        || cursor.col != drawn.cursor_col
+        || cursor.visible != drawn.cursor_visible)
+    {
+        damage.mark(drawn.cursor_line);
+        damage.mark(cursor.line);
+    }
+
+    auto [selection_start, selection_end] = selection_range(editor);
+
+    if (editor.selection_valid && drawn.selection_valid)
+    {
+        // Usually just one end moves while the mouse drags it.
+        if (selection_start != drawn.selection_start)
+            damage.mark(std::min(selection_start.line,
+                                 drawn.selection_start.line),
+                        std::max(selection_start.line,
+                                 drawn.selection_start.line) + 1);
+        if (selection_end != drawn.selection_end)
+            damage.mark(std::min(selection_end.line,
+                                 drawn.selection_end.line),
+                        std::max(selection_end.line,
+                                 drawn.selection_end.line) + 1);
+    }
+    else if (editor.selection_valid != drawn.selection_valid)
+    {
+        if (drawn.selection_valid)
+            damage.mark(drawn.selection_start.line,
+                        drawn.selection_end.line + 1);
+        if (editor.selection_valid)
+            damage.mark(selection_start.line, selection_end.line + 1);
+    }
+
+    // The extra cursors blink along with the main one.
+    if (editor.cursors_version != drawn.cursors_version
+        || (cursor.visible != drawn.cursor_visible
+            && !editor.extra_cursors.empty()))
+    {
+        for (const ExtraCursor& extra : drawn.extra_cursors)
+            damage.mark(extra.start().line, extra.end().line + 1);
+        for (const ExtraCursor& extra : editor.extra_cursors)
+            damage.mark(extra.start().line, extra.end().line + 1);
+
+        drawn.extra_cursors = editor.extra_cursors;
+        drawn.cursors_version = editor.cursors_version;
+    }
+
+    drawn.file_space_x = editor.file_space_x;
+    drawn.file_space_y = editor.file_space_y;
+    drawn.cursor_line = cursor.line;
+    drawn.cursor_col = cursor.col;
+    drawn.cursor_visible = cursor.visible;
+    drawn.selection_valid = editor.selection_valid;
+    drawn.selection_start = selection_start;
+    drawn.selection_end = selection_end;
+}
+
+void update_highlights(Editor& editor, int first_row, int last_row)
+{
+    if (!editor.tree)
+        return;
+
+    zest::profile::ScopedTimer timer(zest::profile::Stage::query);
+
+    zest::highlight::LineRange rebuilt = editor.highlight_cache.rebuild(
+        editor.tree.get(),
+        editor.queries,
+        editor.query_cursor.get(),
+        std::max(0, first_row - editor.highlight_margin),
+        last_row + 1 + editor.highlight_margin);
+
+    editor.damage.mark(rebuilt.first_line, rebuilt.last_line);
+}
+
+static void draw_highlights(Editor& editor, int row, std::string_view line)
+{
+    zest::highlight::SpanCache& cache = editor.highlight_cache;
+    if (!editor.tree || size_t(row) >= cache.line_count())
+        return;
+
+    float y = row*editor.cell_height - editor.file_space_y;
+
+    for (const zest::highlight::Span& span : cache.spans(row))
+    {
+        zest::Color color = zest::highlight::highlights[span.color].color;
+
+        int to = std::min<size_t>(span.end_col, line.size());
+        float x = span.start_col*editor.cell_width - editor.file_space_x;
+
+        if (x >= editor.width
+            || x + (to - int(span.start_col))*editor.cell_width < 0)
+        {
+            continue;
+        }
+
+        draw_text_segment(editor, line, span.start_col, to, { x, y },
+                          color, std::nullopt);
+    }
+}
+
+bool range_columns(zest::CellPos start, zest::CellPos end, int row,
+                   int line_len, int& from, int& to, int& added_len)
+{
+    if (row < start.line || row > end.line)
+        return false;
+
+    from = row == start.line
+                ? start.col
+                : 0;
+    to = row == end.line
+                ? end.col
+                : line_len;
+
+    added_len = end.line > start.line && row != end.line
+                    ? 1
+                    : 0;
+
+    return true;
+}
+
+bool selected_columns(const Editor& editor, int row, int line_len,
+                      int& from, int& to, int& added_len)
+{
+    auto [selection_start, selection_end] = selection_range(editor);
+    return range_columns(selection_start, selection_end, row, line_len,
+                         from, to, added_len);
+}
+
+std::pair<size_t, size_t> extra_cursors_on_row(const Editor& editor,
+                                               int row)
+{
+    // Sorted and not overlapping, so their ends are sorted as well.
+    const std::vector<ExtraCursor>& extras = editor.extra_cursors;
+
+    auto first = std::partition_point(
+        extras.begin(), extras.end(),
+        [&] (const ExtraCursor& extra) { return extra.end().line < row; });
+    auto last = std::partition_point(
+        first, extras.end(),
+        [&] (const ExtraCursor& extra)
+        {
+            return extra.start().line <= row;
+        });
+
+    return { first - extras.begin(), last - extras.begin() };
+}
+
+void matched_columns(const Editor& editor, size_t row_offset, int line_len,
+                     std::vector<std::pair<int, int>>& columns)
+{
+    columns.clear();
+
+    std::vector<zest::ByteRange> matches;
+    editor.search.matches.find(row_offset, row_offset + line_len, matches);
+
+    for (zest::ByteRange match : matches)
+    {
+        int from = match.start - row_offset;
+        int to = std::min<size_t>(match.end - row_offset, line_len);
+        columns.push_back({ from, to });
+    }
+}
+
+// Covers the columns [from, to) of the row, and added_len more cells past
+// them, with color and draws their text again over it.
+static void draw_overlay(Editor& editor, int row, std::string_view line,
+                         int from, int to, int added_len,
+                         zest::Color color, zest::Color text_color)
+{
+    float x = from*editor.cell_width - editor.file_space_x;
+    float y = row*editor.cell_height - editor.file_space_y;
+
+    draw_rectangle(editor,
+                   { x, y, (to - from + added_len)*editor.cell_width,
+                     editor.cell_height },
+                   color);
+
+    draw_text_segment(editor, line, from, to, { x, y }, text_color,
+                      std::nullopt);
+}
+
+static void draw_matches(LineBuffer& line_buffer, Editor& editor, int row,
+                         std::string_view line)
+{
+    zest::profile::ScopedTimer timer(zest::profile::Stage::selection);
+
+    std::vector<std::pair<int, int>> columns;
+    matched_columns(editor, line_buffer.offset_of({ row, 0 }), line.size(),
+                    columns);
+
+    for (auto [from, to] : columns)
+        draw_overlay(editor, row, line, from, to, 0,
+                     Editor::match_color, Editor::matched_text_color);
+}
+
+static void draw_extra_cursors(const CursorState& cursor, Editor& editor,
+                               int row, std::string_view line)
+{
+    zest::profile::ScopedTimer timer(zest::profile::Stage::selection);
+
+    auto [first, last] = extra_cursors_on_row(editor, row);
+    float y = row*editor.cell_height - editor.file_space_y;
+
+    for (size_t i = first; i < last; ++i)
+    {
+        const ExtraCursor& extra = editor.extra_cursors[i];
+
+        int from, to, added_len;
+        if (extra.pos != extra.anchor
+            && range_columns(extra.start(), extra.end(), row, line.size(),
+                             from, to, added_len))
+        {
+            draw_overlay(editor, row, line, from, to, added_len,
+                         Editor::selection_color,
+                         Editor::selected_text_color);
+        }
+
+        if (cursor.visible && extra.pos.line == row)
+        {
+            float x = extra.pos.col*editor.cell_width - editor.file_space_x;
+            draw_rectangle(editor, { x, y, 2, editor.cell_height },
+                           Editor::cursor_color);
+        }
+    }
+}
+
+static void draw_selection(Editor& editor, int row, std::string_view line)
+{
+    zest::profile::ScopedTimer timer(zest::profile::Stage::selection);
+
+    int from, to, added_len;
+    if (!selected_columns(editor, row, line.size(), from, to, added_len))
+        return;
+
+    draw_overlay(editor, row, line, from, to, added_len,
+                 Editor::selection_color, Editor::selected_text_color);
+}
+
+// Redraws the band of the image covered by a single line, rows past the
+// end of the text are just cleared.
+static void draw_line(LineBuffer& line_buffer, CursorState& cursor,
+                      Editor& editor, int row)
+{
+    float y = row*editor.cell_height - editor.file_space_y;
+
+    draw_rectangle(editor, { 0, y, (float)editor.width, editor.cell_height },
+                   Editor::background_color);
+
+    if (size_t(row) >= line_buffer.line_count())
+        return;
+
+    int first_col = editor.file_space_x/editor.cell_width;
+    float x = first_col*editor.cell_width - editor.file_space_x;
+
+    std::string_view line = line_buffer.get_line(row);
+    draw_text_segment(editor, line, first_col, line.size(), { x, y },
+                      Editor::text_color, std::nullopt);
+
+    if (!editor.search.matches.empty())
+        draw_matches(line_buffer, editor, row, line);
+
+    if (editor.selection_valid)
+        draw_selection(editor, row, line);
+
+    if (!editor.extra_cursors.empty())
+        draw_extra_cursors(cursor, editor, row, line);
+
+    if (cursor.visible && cursor.line == row)
+    {
+        float offset_x = cursor.col*editor.cell_width - editor.file_space_x;
+        draw_rectangle(editor, { offset_x, y, 2, editor.cell_height },
+                       Editor::cursor_color);
+    }
+
+    draw_highlights(editor, row, line);
+}
+
+void draw_damage(LineBuffer& line_buffer, CursorState& cursor, Editor& editor,
+                 int first_row, int last_row)
+{
+    zest::profile::ScopedTimer timer(zest::profile::Stage::rasterize);
+
+    for (int i = first_row; i <= last_row; ++i)
+    {
+        if (editor.damage.is_dirty(i))
+            draw_line(line_buffer, cursor, editor, i);
+    }
+}
+
+void visible_rows(const Editor& editor, int& first_row, int& last_row)
+{
+    first_row = editor.file_space_y/editor.cell_height;
+    last_row = (editor.file_space_y + editor.height)/editor.cell_height;
+}
+
+void resize_editor(Editor& editor, int width, int height)
+{
+    editor.width = std::max(width, int(editor.cell_width));
+    editor.height = std::max(height, int(editor.cell_height));
+
+    editor.text_area_rect.width = editor.width;
+    editor.text_area_rect.height = editor.height;
+    editor.view_rect.width = editor.width;
+    editor.view_rect.height = editor.height;
+
+    editor.text_area_pixels.assign(size_t(editor.width)*editor.height*4, 0);
+
+    editor.damage.mark_all();
+}
+
+void init_editor(Editor& editor, int width, int height)
+{
+    editor.top_left_x = 20;
+    editor.top_left_y = 20;
+    editor.text_area_rect = zest::Rect {
+        (float)editor.top_left_x, (float)editor.top_left_y,
+        (float)width, (float)height
+    };
+
+    editor.file_space_x = 0.0f;
+    editor.file_space_y = 0.0f;
+    editor.view_rect = zest::Rect {
+        editor.file_space_x, editor.file_space_y,
+        (float)width, (float)height
+    };
+
+    editor.font_info.regular =
+        zest::load_bdf_cached("../resources/terminus/ter-u18n.bdf");
+    editor.font_info.bold =
+        zest::load_bdf_cached("../resources/terminus/ter-u18b.bdf");
+    editor.font_info.font_size = editor.font_info.regular->cell_height;
+    editor.font_info.char_spacing = 0;
+    editor.font_info.char_step = editor.font_info.regular->cell_width;
+
+    editor.cell_width = editor.font_info.char_step;
+    editor.cell_height = editor.font_info.font_size;
+
+    editor.glyph_atlas = std::make_unique<zest::GlyphAtlas>(
+        editor.cell_width, editor.cell_height,
+        make_font_rasterizer(editor.font_info));
+
+    resize_editor(editor, width, height);
+
+    zest::tree_sitter::ParserPtr parser = zest::tree_sitter::init();
+    editor.queries = zest::tree_sitter::init_highlight_queries(parser.get());
+    editor.query_cursor = zest::tree_sitter::init_query_cursor();
+    editor.parse_worker =
+        std::make_unique<zest::tree_sitter::ParseWorker>(std::move(parser));
+    editor.highlight_margin = 64;
+}
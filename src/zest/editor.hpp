@@ -0,0 +1,271 @@
+#pragma once
+
+#include <zest/bitmap_font.hpp>
+#include <zest/glyph_atlas.hpp>
+#include <zest/highlight/cache.hpp>
+#include <zest/history.hpp>
+#include <zest/input.hpp>
+#include <zest/line_damage.hpp>
+#include <zest/parse_worker.hpp>
+#include <zest/raster.hpp>
+#include <zest/search.hpp>
+#include <zest/text.hpp>
+#include <zest/tree_sitter.hpp>
+#include <zest/types.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+struct CursorState
+{
+    struct MoveState
+    {
+        double down_time = 0.0;
+        bool active = false;
+    };
+
+    double blink_time = 0.5;
+
+    double time = 0.0;
+    bool visible = true;
+
+    int line = 0;
+    int col = 0;
+    int original_col = 0;
+
+    MoveState state_left;
+    MoveState state_right;
+    MoveState state_up;
+    MoveState state_down;
+    MoveState state_backspace;
+    MoveState state_delete;
+    MoveState state_enter;
+
+    double initial_delay = 0.5;
+    double move_rate = 0.05;
+};
+
+// A cursor besides the main one, with a selection from anchor to pos. It
+// has none when they are the same.
+struct ExtraCursor
+{
+    zest::CellPos pos;
+    zest::CellPos anchor;
+
+    zest::CellPos start() const { return std::min(pos, anchor); }
+    zest::CellPos end() const { return std::max(pos, anchor); }
+};
+
+// The search bar and the matches of its query in the text.
+struct SearchState
+{
+    // The bar is open, typed text goes to the query instead of the text.
+    bool active = false;
+    std::string query;
+
+    // The query is a regex rather than literal text.
+    bool regex = false;
+
+    // Why the query is not a valid regex, empty when it is.
+    std::string error;
+
+    std::unique_ptr<zest::Search> search;
+
+    // The query compiled when the search started, if it is a regex.
+    std::shared_ptr<const zest::regex::Regex> compiled;
+
+    // The edits of each change of the text made since the running search
+    // took its snapshot, the matches it finds go through them.
+    std::vector<std::vector<zest::ByteEdit>> pending_edits;
+
+    // The matches found so far, kept in step with edits to the text. None
+    // of them spans lines.
+    zest::MatchList matches;
+
+    // The query changed since the search was started.
+    bool dirty = false;
+
+    // Changes whenever the matches do.
+    uint64_t version = 0;
+};
+
+struct FontInfo
+{
+    std::shared_ptr<const zest::BitmapFont> regular;
+
+    // May be missing, bold text is then derived from the regular font.
+    std::shared_ptr<const zest::BitmapFont> bold;
+
+    int font_size;
+    float char_step;
+    float char_spacing;
+};
+
+// Everything about the text area that does not depend on a window: the
+// view, the selection, the syntax tree and the pixels of the text area,
+// which the frontends only have to show.
+struct Editor
+{
+    static constexpr zest::Color background_color = { 0, 121, 241, 255 };
+    static constexpr zest::Color text_color = { 255, 255, 255, 255 };
+    static constexpr zest::Color cursor_color = { 255, 255, 255, 255 };
+    static constexpr zest::Color selection_color = { 255, 255, 255, 255 };
+    static constexpr zest::Color selected_text_color = { 0, 0, 0, 255 };
+    static constexpr zest::Color match_color = { 253, 249, 0, 255 };
+    static constexpr zest::Color matched_text_color = { 0, 0, 0, 255 };
+
+    int top_left_x;
+    int top_left_y;
+    int width;
+    int height;
+    zest::Rect text_area_rect;
+
+    float file_space_x;
+    float file_space_y;
+    zest::Rect view_rect;
+
+    FontInfo font_info;
+
+    // Glyphs of font_info rasterized into cells of cell_width by
+    // cell_height, all text is drawn from here.
+    std::unique_ptr<zest::GlyphAtlas> glyph_atlas;
+
+    // RGBA pixels of the text area, width by height. Only the lines in
+    // damage are drawn again every frame.
+    std::vector<uint8_t> text_area_pixels;
+
+    float cell_width;
+    float cell_height;
+
+    // Lines that changed since the last frame, only those are drawn again
+    // and uploaded to the texture.
+    zest::LineDamage damage;
+
+    // What the text area image shows at the moment. Compared with the
+    // current state every frame to find the lines that need a redraw.
+    struct DrawnState
+    {
+        float file_space_x = 0.0f;
+        float file_space_y = 0.0f;
+
+        int cursor_line = 0;
+        int cursor_col = 0;
+        bool cursor_visible = false;
+
+        bool selection_valid = false;
+        zest::CellPos selection_start = { 0, 0 };
+        zest::CellPos selection_end = { 0, 0 };
+
+        std::vector<ExtraCursor> extra_cursors;
+        uint64_t cursors_version = 0;
+    };
+    DrawnState drawn;
+
+    bool cursorize_view = false;
+
+    bool selecting = false;
+    bool selection_valid = false;
+    zest::CellPos selection_origin;
+    zest::CellPos selection_current;
+
+    // Sorted, none of them overlaps another cursor or the main one. Every
+    // keystroke edits the text at all cursors as a single change.
+    std::vector<ExtraCursor> extra_cursors;
+
+    // Changes whenever the extra cursors do.
+    uint64_t cursors_version = 0;
+
+    SearchState search;
+
+    // Every edit made through the editor, for undo and redo.
+    zest::History history;
+
+    zest::tree_sitter::HighlightQueries queries;
+
+    zest::tree_sitter::QueryCursorPtr query_cursor {
+        nullptr, zest::tree_sitter::delete_query_cursor };
+
+    std::unique_ptr<zest::tree_sitter::ParseWorker> parse_worker;
+
+    // The last tree finished by the parse worker, with all the edits made
+    // since its snapshot was taken already applied.
+    zest::tree_sitter::TreePtr tree {
+        nullptr, zest::tree_sitter::delete_tree };
+
+    // Edits the tree was not parsed with yet, the first one is edit number
+    // edit_log_base. Only the ones after submitted_edits were not sent to
+    // the parse worker.
+    std::vector<zest::TextEdit> edit_log;
+    uint64_t edit_log_base = 0;
+    uint64_t submitted_edits = 0;
+    bool tree_dirty = true;
+
+    zest::highlight::SpanCache highlight_cache;
+
+    // Lines above and below the view whose highlights are prepared ahead
+    // of scrolling.
+    int highlight_margin;
+
+};
+
+// Loads the fonts and starts the parse worker. The text area starts out
+// at width by height pixels.
+void init_editor(Editor& editor, int width, int height);
+
+// The pixels are lost, everything is drawn again in the next frame.
+void resize_editor(Editor& editor, int width, int height);
+
+// Applies the input of one frame, time_delta seconds after the last one.
+void update(LineBuffer& line_buffer, CursorState& cursor, Editor& editor,
+            const zest::InputState& input, double time_delta);
+
+// Sends the edits to the parse worker and takes the tree it finished, if
+// there is one.
+void update_syntax_tree(Editor& editor, const LineBuffer& line_buff);
+
+// Rows of the text that are at least partly inside the view.
+void visible_rows(const Editor& editor, int& first_row, int& last_row);
+
+// Selection with the start before the end.
+std::pair<zest::CellPos, zest::CellPos> selection_range(const Editor& editor);
+
+// Columns [from, to) of the row covered by the text from start to end.
+// When it continues on the next row, the line break counts as one more
+// cell in added_len.
+bool range_columns(zest::CellPos start, zest::CellPos end, int row,
+                   int line_len, int& from, int& to, int& added_len);
+
+// Same as range_columns, for the selection.
+bool selected_columns(const Editor& editor, int row, int line_len,
+                      int& from, int& to, int& added_len);
+
+// The extra cursors that are on the row or select some of it, as indices
+// [first, last) into extra_cursors.
+std::pair<size_t, size_t> extra_cursors_on_row(const Editor& editor,
+                                               int row);
+
+// Columns [from, to) of the search matches on the row, with the line at
+// row starting at row_offset.
+void matched_columns(const Editor& editor, size_t row_offset, int line_len,
+                     std::vector<std::pair<int, int>>& columns);
+
+// Marks the lines where the view, the cursors or the selections differ
+// from what was drawn last time.
+void update_damage(CursorState& cursor, Editor& editor,
+                   int first_row, int last_row);
+
+// Prepares the highlights of the view, the lines whose spans were rebuilt
+// have to be drawn again.
+void update_highlights(Editor& editor, int first_row, int last_row);
+
+zest::Surface text_area_surface(Editor& editor);
+
+// Draws the dirty lines of the view into the text area pixels. The damage
+// is left for the frontend to clear once it showed the new pixels.
+void draw_damage(LineBuffer& line_buffer, CursorState& cursor, Editor& editor,
+                 int first_row, int last_row);
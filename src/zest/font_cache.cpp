@@ -0,0 +1,196 @@
+#include "font_cache.hpp"
+
+#include <zest/mapped_file.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+
+
+static constexpr char cache_magic[8] = { 'Z', 'E', 'S', 'T', 'F', 'O', 'N', 'T' };
+static constexpr uint32_t cache_version = 1;
+static constexpr uint32_t cache_byte_order = 0x01020304;
+
+static_assert(std::is_trivially_copyable_v<zest::BitmapGlyph>
+              && sizeof(zest::BitmapGlyph) == 16,
+              "The glyph table is stored as it is in memory.");
+
+uint64_t zest::fnv1a(const char* data, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= uint8_t(data[i]);
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+std::string zest::font_cache_path(const std::string& source_path)
+{
+    namespace fs = std::filesystem;
+
+    fs::path dir;
+#ifdef _WIN32
+    if (const char* local_app_data = std::getenv("LOCALAPPDATA"))
+        dir = fs::path(local_app_data) / "zest";
+#else
+    if (const char* cache_home = std::getenv("XDG_CACHE_HOME");
+        cache_home && *cache_home)
+    {
+        dir = fs::path(cache_home) / "zest";
+    }
+    else if (const char* home = std::getenv("HOME"))
+    {
+        dir = fs::path(home) / ".cache" / "zest";
+    }
+#endif
+    if (dir.empty())
+        return {};
+
+    // Fonts of the same name in different directories must not share
+    // a cache file.
+    std::error_code error;
+    std::string absolute = fs::absolute(source_path, error).string();
+
+    char suffix[17];
+    uint64_t hash = fnv1a(absolute.data(), absolute.size());
+    for (int i = 0; i < 16; ++i)
+        suffix[i] = "0123456789abcdef"[(hash >> (60 - 4*i)) & 0xf];
+    suffix[16] = 0;
+
+    fs::path name = fs::path(source_path).stem();
+    name += std::string("-") + suffix + ".zfc";
+
+    return (dir / "fonts" / name).string();
+}
+
+std::optional<zest::BitmapFont>
+zest::read_font_cache(const std::string& cache_path,
+                      uint64_t source_size, uint64_t source_checksum)
+{
+    std::error_code error;
+    if (cache_path.empty() || !std::filesystem::exists(cache_path, error))
+        return std::nullopt;
+
+    std::optional<MappedFile> file;
+    try
+    {
+        file.emplace(cache_path);
+    }
+    catch (const std::runtime_error&)
+    {
+        return std::nullopt;
+    }
+
+    FontCacheHeader header;
+    if (file->size() < sizeof(header))
+        return std::nullopt;
+    std::memcpy(&header, file->data(), sizeof(header));
+
+    if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0
+        || header.version != cache_version
+        || header.byte_order != cache_byte_order
+        || header.source_size != source_size
+        || header.source_checksum != source_checksum)
+    {
+        return std::nullopt;
+    }
+
+    uint64_t glyphs_size = uint64_t(header.glyph_count)*sizeof(BitmapGlyph);
+    if (header.glyphs_offset > file->size()
+        || glyphs_size > file->size() - header.glyphs_offset
+        || header.bitmaps_offset > file->size()
+        || header.bitmaps_size > file->size() - header.bitmaps_offset)
+    {
+        return std::nullopt;
+    }
+
+    BitmapFont font;
+    font.cell_width = header.cell_width;
+    font.cell_height = header.cell_height;
+    font.ascent = header.ascent;
+
+    font.glyphs.resize(header.glyph_count);
+    std::memcpy(font.glyphs.data(), file->data() + header.glyphs_offset,
+                glyphs_size);
+
+    const uint8_t* bitmaps =
+        (const uint8_t*)file->data() + header.bitmaps_offset;
+    font.bitmaps.assign(bitmaps, bitmaps + header.bitmaps_size);
+
+    // Glyphs pointing outside of the bitmaps would be read out of bounds
+    // later, so a damaged file is rejected here.
+    for (const BitmapGlyph& glyph : font.glyphs)
+    {
+        uint64_t end = glyph.bitmap_offset
+                       + uint64_t(glyph.height)*bitmap_row_size(glyph.width);
+        if (end > font.bitmaps.size())
+            return std::nullopt;
+    }
+
+    return font;
+}
+
+bool zest::write_font_cache(const std::string& cache_path,
+                            const BitmapFont& font,
+                            uint64_t source_size, uint64_t source_checksum)
+{
+    namespace fs = std::filesystem;
+
+    if (cache_path.empty())
+        return false;
+
+    FontCacheHeader header = {};
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.byte_order = cache_byte_order;
+    header.source_size = source_size;
+    header.source_checksum = source_checksum;
+    header.cell_width = font.cell_width;
+    header.cell_height = font.cell_height;
+    header.ascent = font.ascent;
+    header.glyph_count = font.glyphs.size();
+    header.glyphs_offset = sizeof(header);
+    header.bitmaps_offset = header.glyphs_offset
+                            + font.glyphs.size()*sizeof(BitmapGlyph);
+    header.bitmaps_size = font.bitmaps.size();
+
+    std::error_code error;
+    fs::create_directories(fs::path(cache_path).parent_path(), error);
+    if (error)
+        return false;
+
+    // Another instance may be writing the same cache at the same time.
+    std::random_device random;
+    std::string temp_path = cache_path + "." + std::to_string(random()) + ".tmp";
+
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)font.glyphs.data(),
+                  font.glyphs.size()*sizeof(BitmapGlyph));
+        out.write((const char*)font.bitmaps.data(), font.bitmaps.size());
+
+        if (!out.flush())
+        {
+            out.close();
+            fs::remove(temp_path, error);
+            return false;
+        }
+    }
+
+    fs::rename(temp_path, cache_path, error);
+    if (error)
+    {
+        fs::remove(temp_path, error);
+        return false;
+    }
+
+    return true;
+}
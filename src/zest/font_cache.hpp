@@ -0,0 +1,56 @@
+#pragma once
+
+#include <zest/bitmap_font.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace zest
+{
+
+// Binary image of a BitmapFont, so that a font only has to be parsed the
+// first time it is used. The file is a FontCacheHeader followed by the
+// glyph table and the packed glyph bitmaps, in the byte order of the
+// machine that wrote it. The header records a checksum of the source
+// file, a cache written for a different version of the source is ignored.
+struct FontCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+
+    uint64_t source_size;
+    uint64_t source_checksum;
+
+    int32_t cell_width;
+    int32_t cell_height;
+    int32_t ascent;
+    uint32_t glyph_count;
+
+    uint64_t glyphs_offset;
+    uint64_t bitmaps_offset;
+    uint64_t bitmaps_size;
+};
+
+// FNV-1a, used as the checksum of the source files.
+uint64_t fnv1a(const char* data, size_t size);
+
+// Where the cache of the given source file lives: a file named after the
+// source in $XDG_CACHE_HOME/zest/fonts, ~/.cache/zest/fonts or
+// %LOCALAPPDATA%/zest/fonts. Empty when none of them is set.
+std::string font_cache_path(const std::string& source_path);
+
+// Empty when the file is missing, damaged or does not match the source.
+std::optional<BitmapFont> read_font_cache(const std::string& cache_path,
+                                          uint64_t source_size,
+                                          uint64_t source_checksum);
+
+// The file is written next to the destination and renamed over it, so a
+// reader never sees it half written. Returns false on failure, the cache
+// is just an optimization.
+bool write_font_cache(const std::string& cache_path, const BitmapFont& font,
+                      uint64_t source_size, uint64_t source_checksum);
+
+} // namespace zest
@@ -0,0 +1,197 @@
+#include "glyph_atlas.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+
+static constexpr uint32_t replacement_character = 0xfffd;
+
+static uint64_t cell_key(uint32_t codepoint, zest::GlyphStyle style)
+{
+    return (uint64_t(codepoint) << 8) | uint8_t(style);
+}
+
+zest::GlyphAtlas::GlyphAtlas(int cell_width, int cell_height,
+                             GlyphRasterizer rasterizer)
+    : cell_width_(cell_width),
+      cell_height_(cell_height),
+      rasterizer_(std::move(rasterizer)),
+      ascii_cells_(128*2, no_cell)
+{ }
+
+uint32_t zest::GlyphAtlas::cell(uint32_t codepoint, GlyphStyle style)
+{
+    uint32_t* ascii = nullptr;
+    if (codepoint < 128 && uint8_t(style) < 2)
+    {
+        ascii = &ascii_cells_[codepoint*2 + uint8_t(style)];
+        if (*ascii != no_cell)
+            return *ascii;
+    }
+    else
+    {
+        auto it = cells_.find(cell_key(codepoint, style));
+        if (it != cells_.end())
+            return it->second;
+    }
+
+    uint32_t index = add_cell(codepoint, style);
+    if (index == no_cell)
+    {
+        if (replacement_cell_ == no_cell)
+            replacement_cell_ = add_cell(replacement_character,
+                                         GlyphStyle::regular);
+        if (replacement_cell_ == no_cell)
+            replacement_cell_ = add_cell('?', GlyphStyle::regular);
+        // Not even a question mark, so missing glyphs stay blank.
+        if (replacement_cell_ == no_cell)
+            replacement_cell_ = allocate_cell();
+
+        index = replacement_cell_;
+    }
+
+    if (ascii)
+        *ascii = index;
+    else
+        cells_.emplace(cell_key(codepoint, style), index);
+
+    return index;
+}
+
+uint32_t zest::GlyphAtlas::solid_cell()
+{
+    if (solid_cell_ != no_cell)
+        return solid_cell_;
+
+    solid_cell_ = allocate_cell();
+
+    uint8_t* coverage = pixels_.data() + cell_y(solid_cell_)*stride()
+                        + cell_x(solid_cell_);
+    for (int j = 0; j < cell_height_; ++j)
+        std::memset(coverage + j*stride(), 255, cell_width_);
+
+    return solid_cell_;
+}
+
+uint32_t zest::GlyphAtlas::allocate_cell()
+{
+    uint32_t index = cell_count_;
+
+    if (int(index/cells_per_row) >= rows_)
+    {
+        // Rows are appended at the end of the image, so the cells already
+        // there keep their place.
+        rows_ = std::max(1, rows_*2);
+        pixels_.resize(size_t(width())*height());
+    }
+
+    uint8_t* coverage = pixels_.data() + cell_y(index)*stride()
+                        + cell_x(index);
+    for (int j = 0; j < cell_height_; ++j)
+        std::memset(coverage + j*stride(), 0, cell_width_);
+
+    cell_count_++;
+    version_++;
+
+    return index;
+}
+
+uint32_t zest::GlyphAtlas::add_cell(uint32_t codepoint, GlyphStyle style)
+{
+    uint32_t index = allocate_cell();
+
+    GlyphCell cell = {
+        pixels_.data() + cell_y(index)*stride() + cell_x(index),
+        stride(), cell_width_, cell_height_
+    };
+
+    if (!rasterizer_(codepoint, style, cell))
+    {
+        // The cell is cleared again when it is handed out next time.
+        cell_count_--;
+        return no_cell;
+    }
+
+    return index;
+}
+
+void zest::GlyphAtlas::draw_text(Surface& surface, int x, int y,
+                                 std::string_view text, Color color,
+                                 GlyphStyle style)
+{
+    if (y >= surface.height || y + cell_height_ <= 0)
+        return;
+
+    size_t i = 0;
+    while (i < text.size() && x < surface.width)
+    {
+        uint32_t codepoint = uint8_t(text[i]);
+        if (codepoint < 0x80)
+            i++;
+        else
+            codepoint = decode_utf8(text, i);
+
+        if (codepoint != ' ' && x + cell_width_ > 0)
+        {
+            uint32_t index = cell(codepoint, style);
+            blend_mask(surface, x, y, cell_coverage(index), stride(),
+                       cell_width_, cell_height_, color);
+        }
+
+        x += cell_width_;
+    }
+}
+
+uint32_t zest::decode_utf8(std::string_view text, size_t& i)
+{
+    uint8_t lead = text[i];
+
+    int length;
+    uint32_t codepoint;
+    if (lead < 0x80)
+    {
+        i++;
+        return lead;
+    }
+    else if ((lead & 0xe0) == 0xc0)
+    {
+        length = 2;
+        codepoint = lead & 0x1f;
+    }
+    else if ((lead & 0xf0) == 0xe0)
+    {
+        length = 3;
+        codepoint = lead & 0x0f;
+    }
+    else if ((lead & 0xf8) == 0xf0)
+    {
+        length = 4;
+        codepoint = lead & 0x07;
+    }
+    else
+    {
+        i++;
+        return replacement_character;
+    }
+
+    if (i + length > text.size())
+    {
+        i++;
+        return replacement_character;
+    }
+
+    for (int k = 1; k < length; ++k)
+    {
+        uint8_t byte = text[i + k];
+        if ((byte & 0xc0) != 0x80)
+        {
+            i++;
+            return replacement_character;
+        }
+        codepoint = (codepoint << 6) | (byte & 0x3f);
+    }
+
+    i += length;
+    return codepoint;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <zest/raster.hpp>
+#include <zest/types.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace zest
+{
+
+enum class GlyphStyle : uint8_t
+{
+    regular,
+    bold,
+};
+
+// Where a rasterizer writes the coverage of a single glyph. It is cleared
+// before and the glyph must stay inside of it.
+struct GlyphCell
+{
+    uint8_t* coverage;
+    size_t stride;
+    int width;
+    int height;
+};
+
+// Draws the glyph of the codepoint in the given style into the cell.
+// Returns false when the font has no such glyph.
+using GlyphRasterizer =
+    std::function<bool(uint32_t codepoint, GlyphStyle style, GlyphCell cell)>;
+
+// Coverage masks of the glyphs of a monospace font, all the same size and
+// packed into a grid in a single 8-bit image. Every (codepoint, style)
+// is rasterized once, on its first use, after that drawing it is just
+// blending its cell into the target.
+class GlyphAtlas
+{
+public:
+    GlyphAtlas(int cell_width, int cell_height, GlyphRasterizer rasterizer);
+
+    int cell_width() const { return cell_width_; }
+    int cell_height() const { return cell_height_; }
+
+    // Index of the cell holding the glyph, rasterizing it if needed. Glyphs
+    // missing in the font share the cell of the replacement character.
+    uint32_t cell(uint32_t codepoint, GlyphStyle style);
+
+    // Index of a cell that is fully covered, so that rectangles can be
+    // drawn from the atlas as well.
+    uint32_t solid_cell();
+
+    // Top left corner of the cell in the atlas image.
+    int cell_x(uint32_t index) const
+    {
+        return (index % cells_per_row)*cell_width_;
+    }
+    int cell_y(uint32_t index) const
+    {
+        return (index / cells_per_row)*cell_height_;
+    }
+
+    const uint8_t* cell_coverage(uint32_t index) const
+    {
+        return pixels_.data() + cell_y(index)*stride() + cell_x(index);
+    }
+
+    // The atlas image, one byte of coverage per pixel. It grows downwards
+    // as more glyphs are added.
+    const uint8_t* pixels() const { return pixels_.data(); }
+    int width() const { return cells_per_row*cell_width_; }
+    int height() const { return rows_*cell_height_; }
+    size_t stride() const { return width(); }
+
+    // Incremented whenever a glyph is added, so that copies of the atlas
+    // know when to update.
+    uint64_t version() const { return version_; }
+
+    // Draws the UTF-8 text as a row of cells starting at the given pixel,
+    // one cell per codepoint.
+    void draw_text(Surface& surface, int x, int y, std::string_view text,
+                   Color color, GlyphStyle style = GlyphStyle::regular);
+
+    static constexpr int cells_per_row = 32;
+
+private:
+    static constexpr uint32_t no_cell = UINT32_MAX;
+
+    int cell_width_;
+    int cell_height_;
+    GlyphRasterizer rasterizer_;
+
+    std::vector<uint8_t> pixels_;
+    uint32_t cell_count_ = 0;
+    int rows_ = 0;
+    uint64_t version_ = 0;
+
+    // ASCII is looked up directly, everything else goes through the map.
+    std::vector<uint32_t> ascii_cells_;
+    std::unordered_map<uint64_t, uint32_t> cells_;
+    uint32_t replacement_cell_ = no_cell;
+    uint32_t solid_cell_ = no_cell;
+
+    uint32_t allocate_cell();
+    uint32_t add_cell(uint32_t codepoint, GlyphStyle style);
+};
+
+// Decodes the codepoint starting at text[i] and moves i past it. Invalid
+// bytes decode to U+FFFD one at a time.
+uint32_t decode_utf8(std::string_view text, size_t& i);
+
+} // namespace zest
@@ -0,0 +1,144 @@
+#include "gpu_text.hpp"
+
+#include <zest/profile.hpp>
+
+#include "rlgl.h"
+
+
+zest::raylib::GpuText::GpuText(zest::GlyphAtlas& atlas)
+    : atlas_(atlas)
+{
+    // Rectangles are drawn from this cell, so it has to be in the texture
+    // from the start.
+    atlas_.solid_cell();
+}
+
+zest::raylib::GpuText::~GpuText()
+{
+    if (texture_.id != 0)
+        UnloadTexture(texture_);
+}
+
+void zest::raylib::GpuText::clear()
+{
+    quads_.clear();
+}
+
+void zest::raylib::GpuText::add_rect(zest::Rect rect, zest::Color color)
+{
+    quads_.push_back({ rect.x, rect.y, rect.width, rect.height,
+                       atlas_.solid_cell(), color });
+}
+
+void zest::raylib::GpuText::add_text(float x, float y, std::string_view text,
+                                     const zest::Color* colors,
+                                     zest::GlyphStyle style)
+{
+    float width = atlas_.cell_width();
+    float height = atlas_.cell_height();
+
+    size_t i = 0;
+    while (i < text.size())
+    {
+        size_t start = i;
+        uint32_t codepoint = zest::decode_utf8(text, i);
+
+        if (codepoint != ' ')
+            quads_.push_back({ x, y, width, height,
+                               atlas_.cell(codepoint, style), colors[start] });
+
+        x += width;
+    }
+}
+
+void zest::raylib::GpuText::draw(zest::Vec2 offset, zest::Rect clip)
+{
+    update_texture();
+
+    float atlas_width = atlas_.width();
+    float atlas_height = atlas_.height();
+    uint32_t solid_cell = atlas_.solid_cell();
+
+    BeginScissorMode(clip.x, clip.y, clip.width, clip.height);
+    rlSetTexture(texture_.id);
+    rlBegin(RL_QUADS);
+
+    for (const Quad& quad : quads_)
+    {
+        float u0 = atlas_.cell_x(quad.cell);
+        float v0 = atlas_.cell_y(quad.cell);
+        float u1 = u0 + atlas_.cell_width();
+        float v1 = v0 + atlas_.cell_height();
+
+        // Stretched rectangles sample only the middle of the solid cell,
+        // so that nothing from the neighbouring cells bleeds in.
+        if (quad.cell == solid_cell)
+        {
+            u0 = u1 = (u0 + u1)/2;
+            v0 = v1 = (v0 + v1)/2;
+        }
+
+        u0 /= atlas_width;
+        u1 /= atlas_width;
+        v0 /= atlas_height;
+        v1 /= atlas_height;
+
+        float x0 = offset.x + quad.x;
+        float y0 = offset.y + quad.y;
+        float x1 = x0 + quad.width;
+        float y1 = y0 + quad.height;
+
+        rlCheckRenderBatchLimit(4);
+
+        rlColor4ub(quad.color.r, quad.color.g, quad.color.b, quad.color.a);
+
+        rlTexCoord2f(u0, v0);
+        rlVertex2f(x0, y0);
+        rlTexCoord2f(u0, v1);
+        rlVertex2f(x0, y1);
+        rlTexCoord2f(u1, v1);
+        rlVertex2f(x1, y1);
+        rlTexCoord2f(u1, v0);
+        rlVertex2f(x1, y0);
+    }
+
+    rlEnd();
+    rlSetTexture(0);
+    EndScissorMode();
+}
+
+void zest::raylib::GpuText::update_texture()
+{
+    if (texture_.id != 0 && texture_version_ == atlas_.version())
+        return;
+
+    zest::profile::ScopedTimer timer(zest::profile::Stage::upload);
+
+    // The atlas only holds coverage, white with that alpha is tinted by
+    // the vertex colors.
+    size_t pixel_count = size_t(atlas_.width())*atlas_.height();
+    upload_buffer_.resize(pixel_count*2);
+    for (size_t i = 0; i < pixel_count; ++i)
+    {
+        upload_buffer_[2*i] = 255;
+        upload_buffer_[2*i + 1] = atlas_.pixels()[i];
+    }
+
+    if (texture_.width != atlas_.width() || texture_.height != atlas_.height())
+    {
+        if (texture_.id != 0)
+            UnloadTexture(texture_);
+
+        Image image = {
+            upload_buffer_.data(), atlas_.width(), atlas_.height(),
+            1, PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA
+        };
+        texture_ = LoadTextureFromImage(image);
+    }
+    else
+    {
+        UpdateTexture(texture_, upload_buffer_.data());
+    }
+
+    texture_version_ = atlas_.version();
+}
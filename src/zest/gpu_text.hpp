@@ -0,0 +1,65 @@
+#pragma once
+
+#include <zest/glyph_atlas.hpp>
+#include <zest/raylib_wrapper.hpp>
+#include <zest/types.hpp>
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace zest
+{
+
+namespace raylib
+{
+
+// Draws text as textured quads straight from a copy of the glyph atlas in
+// a texture, instead of compositing it into an image on the CPU. Glyphs
+// and rectangles are collected during the frame and submitted together,
+// all with the same texture, so raylib sends them in one batch.
+class GpuText
+{
+public:
+    explicit GpuText(zest::GlyphAtlas& atlas);
+    ~GpuText();
+
+    GpuText(const GpuText&) = delete;
+    GpuText& operator=(const GpuText&) = delete;
+
+    void clear();
+
+    void add_rect(zest::Rect rect, zest::Color color);
+
+    // One cell per codepoint starting at the given pixel. The color of a
+    // codepoint is colors[i], where i is the index of its first byte.
+    void add_text(float x, float y, std::string_view text,
+                  const zest::Color* colors,
+                  zest::GlyphStyle style = zest::GlyphStyle::regular);
+
+    // Draws everything added since the last clear, moved by the offset and
+    // clipped to the rectangle.
+    void draw(zest::Vec2 offset, zest::Rect clip);
+
+private:
+    struct Quad
+    {
+        float x, y;
+        float width, height;
+        uint32_t cell;
+        zest::Color color;
+    };
+
+    zest::GlyphAtlas& atlas_;
+    Texture2D texture_ {};
+    uint64_t texture_version_ = 0;
+
+    std::vector<Quad> quads_;
+    std::vector<uint8_t> upload_buffer_;
+
+    void update_texture();
+};
+
+} // namespace raylib
+
+} // namespace zest
@@ -0,0 +1,221 @@
+#include "cache.hpp"
+
+#include <zest/highlight/captures.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+
+
+using namespace zest::highlight;
+
+
+const std::vector<Span>& SpanCache::spans(size_t line) const
+{
+    static const std::vector<Span> no_spans;
+
+    if (line < first_line_ || line - first_line_ >= lines_.size())
+        return no_spans;
+    return lines_[line - first_line_].spans;
+}
+
+void SpanCache::reset(size_t line_count)
+{
+    line_count_ = line_count;
+    first_line_ = 0;
+    lines_.clear();
+}
+
+void SpanCache::apply_edit(const zest::TextEdit& edit)
+{
+    size_t start = edit.start.line;
+    size_t removed = edit.old_end.line - edit.start.line;
+    size_t added = edit.new_end.line - edit.start.line;
+
+    line_count_ = line_count_ - removed + added;
+
+    if (start >= first_line_ + lines_.size())
+        return;
+
+    // Only the lines after the edit stay in the window, they move by the
+    // lines it added or removed.
+    if (start < first_line_)
+    {
+        size_t old_end = edit.old_end.line;
+        size_t gone = 0;
+        if (old_end >= first_line_)
+            gone = std::min(old_end + 1 - first_line_, lines_.size());
+
+        if (gone == lines_.size())
+        {
+            reset(line_count_);
+            return;
+        }
+
+        lines_.erase(lines_.begin(), lines_.begin() + gone);
+        first_line_ = first_line_ + gone + added - removed;
+        return;
+    }
+
+    size_t local = start - first_line_;
+    size_t size = lines_.size();
+
+    lines_[local].dirty = true;
+    lines_.erase(lines_.begin() + local + 1,
+                 lines_.begin() + std::min(local + 1 + removed, size));
+
+    // The window never grows, a long insertion ends it instead.
+    size_t inserted = std::min(added, size);
+    lines_.insert(lines_.begin() + local + 1, inserted, Line{});
+    if (inserted < added)
+        lines_.resize(local + 1 + inserted);
+    if (lines_.size() > size)
+        lines_.resize(size);
+}
+
+void SpanCache::apply_edits(const std::vector<zest::TextEdit>& edits)
+{
+    // From the end of the text on, an edit never moves the ones before it.
+    for (const zest::TextEdit& edit : edits)
+        apply_edit(edit);
+}
+
+void SpanCache::invalidate_changes(const TSTree* old_tree,
+                                   const TSTree* new_tree)
+{
+    if (!old_tree)
+    {
+        invalidate(0, lines_.size());
+        return;
+    }
+
+    uint32_t count;
+    TSRange* ranges = ts_tree_get_changed_ranges(old_tree, new_tree, &count);
+
+    for (uint32_t i = 0; i < count; ++i)
+        invalidate(ranges[i].start_point.row, ranges[i].end_point.row + 1);
+
+    std::free(ranges);
+}
+
+LineRange SpanCache::rebuild(
+    const TSTree* tree,
+    const zest::tree_sitter::HighlightQueries& queries,
+    TSQueryCursor* query_cursor,
+    size_t first_line, size_t last_line)
+{
+    last_line = std::min(last_line, line_count_);
+    if (first_line >= last_line)
+        return {};
+
+    move_window(first_line, last_line);
+
+    LineRange rebuilt;
+    size_t line = first_line;
+    while (line < last_line)
+    {
+        if (!lines_[line - first_line_].dirty)
+        {
+            line++;
+            continue;
+        }
+
+        size_t first = line;
+        while (line < last_line && lines_[line - first_line_].dirty)
+            line++;
+
+        rebuild_lines(first, line, tree, queries, query_cursor);
+
+        if (rebuilt.first_line == rebuilt.last_line)
+            rebuilt.first_line = first;
+        rebuilt.last_line = line;
+    }
+
+    return rebuilt;
+}
+
+// The window takes the range and as many lines again on both sides, so
+// scrolling keeps most of it. Lines still in the new window keep their
+// spans.
+void SpanCache::move_window(size_t first_line, size_t last_line)
+{
+    size_t window_end = first_line_ + lines_.size();
+    if (first_line >= first_line_ && last_line <= window_end)
+        return;
+
+    size_t margin = last_line - first_line;
+    size_t new_first = first_line - std::min(first_line, margin);
+    size_t new_last = std::min(last_line + margin, line_count_);
+
+    std::vector<Line>& lines = spare_lines_;
+    lines.clear();
+    lines.reserve(new_last - new_first);
+
+    for (size_t line = new_first; line < new_last; ++line)
+    {
+        if (line >= first_line_ && line < window_end)
+            lines.push_back(std::move(lines_[line - first_line_]));
+        else
+            lines.emplace_back();
+    }
+
+    std::swap(lines_, spare_lines_);
+    first_line_ = new_first;
+}
+
+void SpanCache::invalidate(size_t first_line, size_t last_line)
+{
+    first_line = std::max(first_line, first_line_);
+    last_line = std::min(last_line, first_line_ + lines_.size());
+
+    for (size_t i = first_line; i < last_line; ++i)
+        lines_[i - first_line_].dirty = true;
+}
+
+void SpanCache::rebuild_lines(
+    size_t first_line, size_t last_line,
+    const TSTree* tree,
+    const zest::tree_sitter::HighlightQueries& queries,
+    TSQueryCursor* query_cursor)
+{
+    for (size_t i = first_line; i < last_line; ++i)
+    {
+        lines_[i - first_line_].spans.clear();
+        lines_[i - first_line_].dirty = false;
+    }
+
+    ts_query_cursor_set_point_range(query_cursor,
+                                    { uint32_t(first_line), 0 },
+                                    { uint32_t(last_line), 0 });
+    ts_query_cursor_exec(query_cursor, queries.query.get(),
+                         ts_tree_root_node(tree));
+
+    TSQueryMatch match;
+    uint32_t capture_idx;
+
+    while (ts_query_cursor_next_capture(query_cursor, &match, &capture_idx))
+    {
+        const TSQueryCapture& capture = match.captures[capture_idx];
+
+        uint8_t color = queries.capture_colors[capture.index];
+        if (color == no_color)
+            continue;
+
+        TSPoint start = ts_node_start_point(capture.node);
+        TSPoint end = ts_node_end_point(capture.node);
+
+        // Captures spanning several rows are split into one span per row,
+        // the rows in between are covered up to their end.
+        size_t first_row = std::max<size_t>(start.row, first_line);
+        size_t last_row = std::min<size_t>(end.row, last_line - 1);
+
+        for (size_t row = first_row; row <= last_row; ++row)
+        {
+            uint32_t from = row == start.row ? start.column : 0;
+            uint32_t to = row == end.row ? end.column : to_line_end;
+
+            if (from < to)
+                lines_[row - first_line_].spans.push_back(
+                    { from, to, color });
+        }
+    }
+}
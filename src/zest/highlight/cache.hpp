@@ -0,0 +1,99 @@
+#pragma once
+
+#include <zest/tree_sitter.hpp>
+#include <zest/types.hpp>
+
+#include <tree_sitter/api.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace zest
+{
+
+namespace highlight
+{
+
+// End column of a span that continues past the end of its line.
+constexpr uint32_t to_line_end = UINT32_MAX;
+
+// Lines in [first_line, last_line).
+struct LineRange
+{
+    size_t first_line = 0;
+    size_t last_line = 0;
+};
+
+struct Span
+{
+    uint32_t start_col;
+    uint32_t end_col;
+
+    // Index into highlights.
+    uint32_t color;
+};
+
+// Highlight spans of the lines of the text, sorted by the start column.
+// Edits and reparses only mark the lines they touch as dirty and only those
+// are rebuilt, by running the queries on just their rows. Only a window of
+// lines around the range rebuilt last is kept, the lines outside of it are
+// dirty, so an edit costs the same however long the text is.
+class SpanCache
+{
+public:
+    size_t line_count() const { return line_count_; }
+
+    // Empty for lines outside the window.
+    const std::vector<Span>& spans(size_t line) const;
+
+    // Throws away all spans, every line becomes dirty.
+    void reset(size_t line_count);
+
+    // Keeps the lines in sync with the text, the edited lines become dirty.
+    void apply_edit(const zest::TextEdit& edit);
+
+    // Same as applying the edits one by one, in a single pass over the
+    // lines however many edits there are. The edits must not overlap and
+    // be sorted by their start, last first, all positions are from before
+    // any of them, as when they are applied to the text from the end on.
+    void apply_edits(const std::vector<zest::TextEdit>& edits);
+
+    // Marks the lines that differ between the two trees as dirty. The old
+    // tree must already include all edits the new one was parsed with.
+    void invalidate_changes(const TSTree* old_tree, const TSTree* new_tree);
+
+    // Rebuilds the dirty lines in [first_line, last_line), the others stay
+    // dirty until they are requested, so the cost depends on the size of
+    // the range and not on the size of the file. The window moves to the
+    // range when it is not inside already. Returns the range covering all
+    // the rebuilt lines, empty when there was nothing to rebuild.
+    LineRange rebuild(const TSTree* tree,
+                      const zest::tree_sitter::HighlightQueries& queries,
+                      TSQueryCursor* query_cursor,
+                      size_t first_line, size_t last_line);
+
+private:
+    struct Line
+    {
+        std::vector<Span> spans;
+        bool dirty = true;
+    };
+
+    size_t line_count_ = 0;
+
+    // The lines [first_line_, first_line_ + lines_.size()).
+    size_t first_line_ = 0;
+    std::vector<Line> lines_;
+    std::vector<Line> spare_lines_;
+
+    void move_window(size_t first_line, size_t last_line);
+    void invalidate(size_t first_line, size_t last_line);
+    void rebuild_lines(size_t first_line, size_t last_line,
+                       const TSTree* tree,
+                       const zest::tree_sitter::HighlightQueries& queries,
+                       TSQueryCursor* query_cursor);
+};
+
+} // namespace highlight
+
+} // namespace zest
@@ -2,7 +2,7 @@
 
 #include <zest/types.hpp>
 
-#include <map>
+#include <cstdint>
 #include <string_view>
 
 namespace zest
@@ -11,10 +11,23 @@ namespace zest
 namespace highlight
 {
 
-inline std::map<std::string_view, zest::Color> highlights = {
+struct Highlight
+{
+    std::string_view name;
+    zest::Color color;
+};
+
+// Index into highlights of a capture that is not highlighted.
+constexpr uint8_t no_color = UINT8_MAX;
+
+// A capture without an exact match here falls back to its name up to the
+// last dot, so "bool.constant" gets the color of "bool".
+inline const Highlight highlights[] = {
     { "keyword", zest::Color{ 255, 0, 0, 255 } },
-    { "bool.constant", zest::Color{ 255, 0, 255, 255 } },
-    { "function", zest::Color{ 0, 255, 0, 255 } }
+    { "bool", zest::Color{ 255, 0, 255, 255 } },
+    { "function", zest::Color{ 0, 255, 0, 255 } },
+    { "comment", zest::Color{ 150, 150, 150, 255 } },
+    { "string", zest::Color{ 255, 200, 0, 255 } }
 };
 
 } // namespace highlight
@@ -23,6 +23,15 @@ inline const char* cpp_queries = R"(
     (function_definition
         declarator: (function_declarator
             declarator: (identifier) @function ))
+
+    (comment) @comment
+
+    [
+        (string_literal)
+        (raw_string_literal)
+        (char_literal)
+        (system_lib_string)
+    ] @string
 )";
 
 } // namespace highlight
@@ -0,0 +1,527 @@
+#include "history.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+
+// Edits further apart than this in seconds are separate steps.
+static constexpr double coalesce_interval = 1.0;
+
+// The journal is written in segments of about this many bytes of steps.
+static constexpr size_t segment_size = 1024*1024;
+
+static double now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static bool is_word_byte(char c)
+{
+    uint8_t byte = c;
+    return (byte >= '0' && byte <= '9') || (byte >= 'a' && byte <= 'z')
+           || (byte >= 'A' && byte <= 'Z') || byte == '_' || byte >= 0x80;
+}
+
+static void put_varint(std::string& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out += char(0x80 | (value & 0x7f));
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+static uint64_t get_varint(std::string_view in, size_t& pos)
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (pos >= in.size())
+            throw std::runtime_error("Truncated history journal");
+
+        uint8_t byte = in[pos++];
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+
+    throw std::runtime_error("Corrupt history journal");
+}
+
+// LZ77 with a single hash table, which is plenty for text: a sequence of
+// literal runs, each followed by a copy of earlier output, as varints.
+// A copy of length 0 ends the data.
+static std::string compress(std::string_view in)
+{
+    constexpr int hash_bits = 14;
+    constexpr size_t min_match = 4;
+
+    std::vector<size_t> table(size_t(1) << hash_bits, SIZE_MAX);
+    std::string out;
+
+    size_t literal_start = 0;
+    size_t i = 0;
+    while (i + min_match <= in.size())
+    {
+        uint32_t word;
+        std::memcpy(&word, in.data() + i, sizeof(word));
+        uint32_t hash = (word*2654435761u) >> (32 - hash_bits);
+
+        size_t candidate = table[hash];
+        table[hash] = i;
+
+        if (candidate == SIZE_MAX
+            || std::memcmp(in.data() + candidate, in.data() + i,
+                           min_match) != 0)
+        {
+            i++;
+            continue;
+        }
+
+        size_t length = min_match;
+        while (i + length < in.size()
+               && in[candidate + length] == in[i + length])
+        {
+            length++;
+        }
+
+        put_varint(out, i - literal_start);
+        out.append(in.substr(literal_start, i - literal_start));
+        put_varint(out, length);
+        put_varint(out, i - candidate);
+
+        i += length;
+        literal_start = i;
+    }
+
+    put_varint(out, in.size() - literal_start);
+    out.append(in.substr(literal_start));
+    put_varint(out, 0);
+
+    return out;
+}
+
+static std::string decompress(std::string_view in, size_t size)
+{
+    std::string out;
+    out.reserve(size);
+
+    size_t pos = 0;
+    while (true)
+    {
+        size_t literals = get_varint(in, pos);
+        if (literals > in.size() - pos || literals > size - out.size())
+            throw std::runtime_error("Corrupt history journal");
+        out.append(in.substr(pos, literals));
+        pos += literals;
+
+        size_t length = get_varint(in, pos);
+        if (length == 0)
+            break;
+
+        size_t distance = get_varint(in, pos);
+        if (distance == 0 || distance > out.size()
+            || length > size - out.size())
+        {
+            throw std::runtime_error("Corrupt history journal");
+        }
+
+        // Byte by byte, the copy may overlap what it appends.
+        size_t from = out.size() - distance;
+        for (size_t i = 0; i < length; ++i)
+            out += out[from + i];
+    }
+
+    if (out.size() != size)
+        throw std::runtime_error("Corrupt history journal");
+
+    return out;
+}
+
+zest::History::History(size_t memory_limit)
+    : memory_limit_(memory_limit)
+{}
+
+zest::History::~History()
+{
+    if (journal_)
+        std::fclose(journal_);
+}
+
+zest::History::History(History&& other)
+    : memory_limit_(other.memory_limit_)
+    , memory_usage_(other.memory_usage_)
+    , steps_(std::move(other.steps_))
+    , current_(other.current_)
+    , sealed_(other.sealed_)
+    , journal_(other.journal_)
+    , journal_failed_(other.journal_failed_)
+    , segments_(std::move(other.segments_))
+{
+    other.memory_usage_ = 0;
+    other.steps_.clear();
+    other.current_ = 0;
+    other.sealed_ = true;
+    other.journal_ = nullptr;
+    other.journal_failed_ = false;
+    other.segments_.clear();
+}
+
+zest::History& zest::History::operator=(History&& other)
+{
+    if (this == &other)
+        return *this;
+
+    if (journal_)
+        std::fclose(journal_);
+
+    memory_limit_ = other.memory_limit_;
+    memory_usage_ = other.memory_usage_;
+    steps_ = std::move(other.steps_);
+    current_ = other.current_;
+    sealed_ = other.sealed_;
+    journal_ = other.journal_;
+    journal_failed_ = other.journal_failed_;
+    segments_ = std::move(other.segments_);
+
+    other.memory_usage_ = 0;
+    other.steps_.clear();
+    other.current_ = 0;
+    other.sealed_ = true;
+    other.journal_ = nullptr;
+    other.journal_failed_ = false;
+    other.segments_.clear();
+
+    return *this;
+}
+
+size_t zest::History::step_usage(const Step& step)
+{
+    return sizeof(Step) + step.ops.capacity()*sizeof(Op)
+           + step.bytes.capacity();
+}
+
+bool zest::History::can_undo() const
+{
+    return current_ > 0 || !segments_.empty();
+}
+
+// Typing on after the last insertion, or deleting on before or after the
+// last deletion, without starting a new word.
+bool zest::History::continues(const Step& step, size_t offset,
+                              std::string_view deleted,
+                              std::string_view inserted, double time) const
+{
+    if (sealed_ || time - step.time > coalesce_interval)
+        return false;
+
+    const Op& last = step.ops.back();
+    const char* last_deleted = step.bytes.data() + last.data;
+    const char* last_inserted = last_deleted + last.deleted_size;
+
+    if (deleted.empty() && last.deleted_size == 0)
+    {
+        return offset == last.offset + last.inserted_size
+               && !(is_word_byte(inserted.front())
+                    && !is_word_byte(last_inserted[last.inserted_size - 1]));
+    }
+
+    if (inserted.empty() && last.inserted_size == 0)
+    {
+        // Backspace.
+        if (offset + deleted.size() == last.offset)
+            return !(is_word_byte(deleted.back())
+                     && !is_word_byte(last_deleted[0]));
+
+        // Delete.
+        if (offset == last.offset)
+            return !(is_word_byte(deleted.front())
+                     && !is_word_byte(last_deleted[last.deleted_size - 1]));
+    }
+
+    return false;
+}
+
+void zest::History::record(size_t offset, std::string_view deleted,
+                           std::string_view inserted)
+{
+    if (deleted.empty() && inserted.empty())
+        return;
+
+    double time = now();
+
+    if (current_ == steps_.size() && !steps_.empty()
+        && continues(steps_.back(), offset, deleted, inserted, time))
+    {
+        Step& step = steps_.back();
+        Op& last = step.ops.back();
+
+        memory_usage_ -= step_usage(step);
+
+        // The bytes of the last operation are at the end of the step.
+        if (!inserted.empty())
+        {
+            step.bytes.append(inserted);
+            last.inserted_size += inserted.size();
+        }
+        else if (offset == last.offset)
+        {
+            step.bytes.append(deleted);
+            last.deleted_size += deleted.size();
+        }
+        else
+        {
+            step.bytes.insert(last.data, deleted);
+            last.offset = offset;
+            last.deleted_size += deleted.size();
+        }
+
+        step.time = time;
+        memory_usage_ += step_usage(step);
+
+        if (memory_usage_ > memory_limit_)
+            spill();
+        return;
+    }
+
+    Step step;
+    step.ops.push_back({ offset, 0, deleted.size(), inserted.size() });
+    step.bytes.reserve(deleted.size() + inserted.size());
+    step.bytes.append(deleted);
+    step.bytes.append(inserted);
+    step.time = time;
+
+    push_step(std::move(step));
+    sealed_ = false;
+}
+
+void zest::History::record_batch(const std::vector<EditOp>& ops)
+{
+    if (ops.empty())
+        return;
+
+    Step step;
+    step.time = now();
+
+    size_t size = 0;
+    for (const EditOp& op : ops)
+        size += op.deleted.size() + op.inserted.size();
+    step.bytes.reserve(size);
+
+    step.ops.reserve(ops.size());
+    for (const EditOp& op : ops)
+    {
+        step.ops.push_back({ op.offset, step.bytes.size(),
+                             op.deleted.size(), op.inserted.size() });
+        step.bytes.append(op.deleted);
+        step.bytes.append(op.inserted);
+    }
+
+    push_step(std::move(step));
+    sealed_ = true;
+}
+
+// A new step after undo starts a new branch, the old one is dropped.
+void zest::History::push_step(Step step)
+{
+    while (steps_.size() > current_)
+    {
+        memory_usage_ -= step_usage(steps_.back());
+        steps_.pop_back();
+    }
+
+    memory_usage_ += step_usage(step);
+    steps_.push_back(std::move(step));
+    current_++;
+
+    if (memory_usage_ > memory_limit_)
+        spill();
+}
+
+std::vector<zest::EditOp> zest::History::undo()
+{
+    if (current_ == 0 && !load_segment())
+        return {};
+
+    sealed_ = true;
+
+    const Step& step = steps_[--current_];
+
+    // After the step every operation is further on by what the ones before
+    // it changed.
+    std::vector<EditOp> ops;
+    ops.reserve(step.ops.size());
+    ptrdiff_t shift = 0;
+    for (const Op& op : step.ops)
+    {
+        std::string_view bytes(step.bytes.data() + op.data,
+                               op.deleted_size + op.inserted_size);
+        ops.push_back({ op.offset + shift,
+                        bytes.substr(op.deleted_size),
+                        bytes.substr(0, op.deleted_size) });
+        shift += ptrdiff_t(op.inserted_size) - ptrdiff_t(op.deleted_size);
+    }
+
+    return ops;
+}
+
+std::vector<zest::EditOp> zest::History::redo()
+{
+    if (current_ == steps_.size())
+        return {};
+
+    sealed_ = true;
+
+    const Step& step = steps_[current_++];
+
+    std::vector<EditOp> ops;
+    ops.reserve(step.ops.size());
+    for (const Op& op : step.ops)
+    {
+        std::string_view bytes(step.bytes.data() + op.data,
+                               op.deleted_size + op.inserted_size);
+        ops.push_back({ op.offset,
+                        bytes.substr(0, op.deleted_size),
+                        bytes.substr(op.deleted_size) });
+    }
+
+    return ops;
+}
+
+// Moves the oldest steps to the journal until the rest fits in the memory
+// limit. The step being recorded always stays in memory. Without a
+// journal the oldest steps are dropped instead.
+void zest::History::spill()
+{
+    if (!journal_ && !journal_failed_)
+    {
+        journal_ = std::tmpfile();
+        journal_failed_ = !journal_;
+    }
+
+    while (memory_usage_ > memory_limit_ && current_ > 1)
+    {
+        std::string raw;
+        size_t count = 0;
+        while (count + 1 < current_ && raw.size() < segment_size)
+        {
+            const Step& step = steps_[count++];
+
+            put_varint(raw, step.ops.size());
+            put_varint(raw, step.bytes.size());
+            for (const Op& op : step.ops)
+            {
+                put_varint(raw, op.offset);
+                put_varint(raw, op.data);
+                put_varint(raw, op.deleted_size);
+                put_varint(raw, op.inserted_size);
+            }
+            raw += step.bytes;
+        }
+
+        if (!journal_failed_)
+        {
+            std::string compressed = compress(raw);
+
+            Segment segment;
+            segment.file_offset = segments_.empty()
+                ? 0
+                : segments_.back().file_offset
+                      + long(segments_.back().compressed_size);
+            segment.compressed_size = compressed.size();
+            segment.size = raw.size();
+            segment.step_count = count;
+
+            if (std::fseek(journal_, segment.file_offset, SEEK_SET) == 0
+                && std::fwrite(compressed.data(), 1, compressed.size(),
+                               journal_) == compressed.size())
+            {
+                segments_.push_back(segment);
+            }
+            else
+            {
+                journal_failed_ = true;
+            }
+        }
+
+        // Dropped steps leave a gap the older ones cannot be undone over.
+        if (journal_failed_)
+            segments_.clear();
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            memory_usage_ -= step_usage(steps_.front());
+            steps_.pop_front();
+        }
+        current_ -= count;
+    }
+}
+
+// Reads the newest segment of the journal back in front of the steps in
+// memory. Its space in the file is reused by the next segment written.
+bool zest::History::load_segment()
+{
+    if (segments_.empty())
+        return false;
+
+    Segment segment = segments_.back();
+    segments_.pop_back();
+
+    std::string compressed(segment.compressed_size, '\0');
+    if (std::fseek(journal_, segment.file_offset, SEEK_SET) != 0
+        || std::fread(compressed.data(), 1, compressed.size(), journal_)
+               != compressed.size())
+    {
+        segments_.clear();
+        return false;
+    }
+
+    std::vector<Step> steps;
+    try
+    {
+        std::string raw = decompress(compressed, segment.size);
+
+        size_t pos = 0;
+        for (size_t i = 0; i < segment.step_count; ++i)
+        {
+            Step step;
+            step.time = 0.0;
+
+            size_t op_count = get_varint(raw, pos);
+            size_t byte_count = get_varint(raw, pos);
+            for (size_t j = 0; j < op_count; ++j)
+            {
+                Op op;
+                op.offset = get_varint(raw, pos);
+                op.data = get_varint(raw, pos);
+                op.deleted_size = get_varint(raw, pos);
+                op.inserted_size = get_varint(raw, pos);
+                step.ops.push_back(op);
+            }
+
+            if (byte_count > raw.size() - pos)
+                throw std::runtime_error("Corrupt history journal");
+            step.bytes = raw.substr(pos, byte_count);
+            pos += byte_count;
+
+            steps.push_back(std::move(step));
+        }
+    }
+    catch (const std::runtime_error&)
+    {
+        segments_.clear();
+        return false;
+    }
+
+    for (auto it = steps.rbegin(); it != steps.rend(); ++it)
+    {
+        memory_usage_ += step_usage(*it);
+        steps_.push_front(std::move(*it));
+    }
+    current_ += steps.size();
+
+    return true;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace zest
+{
+
+// One change of the text: the bytes deleted at offset were replaced with
+// the bytes inserted.
+struct EditOp
+{
+    size_t offset;
+    std::string_view deleted;
+    std::string_view inserted;
+};
+
+// Undo history as an append-only log of edit operations, grouped into the
+// steps undo and redo take. Nothing but the changed bytes is stored, and
+// undoing or redoing a step costs time in the size of its edits only.
+//
+// Edits that continue the previous one, typing on or deleting further
+// within a second, join its operation unless they start a new word.
+// Once the history takes more memory than the limit, its oldest steps are
+// compressed into a journal in a temporary file and read back when undo
+// gets to them.
+class History
+{
+public:
+    explicit History(size_t memory_limit = 16*1024*1024);
+    ~History();
+
+    History(const History&) = delete;
+    History& operator=(const History&) = delete;
+
+    // The journal goes along with the steps.
+    History(History&& other);
+    History& operator=(History&& other);
+
+    // Records an edit just made to the text. Steps that were undone can no
+    // longer be redone afterwards.
+    void record(size_t offset, std::string_view deleted,
+                std::string_view inserted);
+
+    // Records edits made to the text together as a single step. The
+    // operations are sorted by offset and do not overlap, all offsets are
+    // into the text from before any of them.
+    void record_batch(const std::vector<EditOp>& ops);
+
+    // The next edit starts a new step, even if it continues this one.
+    void seal() { sealed_ = true; }
+
+    bool can_undo() const;
+    bool can_redo() const { return current_ < steps_.size(); }
+
+    // The operations that take the text back to before the last step.
+    // Like those of record_batch they are sorted by offset and do not
+    // overlap, all offsets are into the text as it is now, so they apply
+    // as a single replace. Empty when there is nothing to undo. The views
+    // are valid until the next call.
+    std::vector<EditOp> undo();
+
+    // The operations of the step undone last, in the same form as undo.
+    std::vector<EditOp> redo();
+
+    // Bytes held in memory, the journal not included.
+    size_t memory_usage() const { return memory_usage_; }
+
+private:
+    struct Op
+    {
+        size_t offset;
+        // Where the deleted bytes start in Step::bytes, the inserted ones
+        // follow them.
+        size_t data;
+        size_t deleted_size;
+        size_t inserted_size;
+    };
+
+    struct Step
+    {
+        // Sorted by offset, with offsets from before the step.
+        std::vector<Op> ops;
+        std::string bytes;
+        double time;
+    };
+
+    // Steps written to the journal, the newest last.
+    struct Segment
+    {
+        long file_offset;
+        size_t compressed_size;
+        size_t size;
+        size_t step_count;
+    };
+
+    size_t memory_limit_;
+    size_t memory_usage_ = 0;
+
+    // Steps before current_ are done, the others were undone.
+    std::deque<Step> steps_;
+    size_t current_ = 0;
+    bool sealed_ = true;
+
+    std::FILE* journal_ = nullptr;
+    bool journal_failed_ = false;
+    std::vector<Segment> segments_;
+
+    static size_t step_usage(const Step& step);
+
+    void push_step(Step step);
+    bool continues(const Step& step, size_t offset,
+                   std::string_view deleted, std::string_view inserted,
+                   double time) const;
+    void spill();
+    bool load_segment();
+};
+
+} // namespace zest
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <zest/types.hpp>
+
+#include <array>
+#include <string>
+
+namespace zest
+{
+
+// The input of one frame, as far as the editor cares. Frontends fill it
+// from their window system, benchmarks from a script, so the editor never
+// asks a window for anything itself.
+struct InputState
+{
+    // Keys the editor repeats while they are held down.
+    enum class Key
+    {
+        left,
+        right,
+        up,
+        down,
+        backspace,
+        del,
+        enter,
+    };
+
+    static constexpr int key_count = int(Key::enter) + 1;
+
+    struct KeyState
+    {
+        // Went down during this frame.
+        bool pressed = false;
+        bool down = false;
+    };
+
+    std::array<KeyState, key_count> keys {};
+
+    // Shortcuts, already told apart from typed text by the frontend. True
+    // only in the frame they were given.
+    enum class Command
+    {
+        find,
+        find_next,
+        cancel,
+        // Switches the search between literal text and a regex.
+        toggle_regex,
+        undo,
+        redo,
+        // Puts a cursor on every search match, with the match selected.
+        select_all_matches,
+        // Left to the frontend, which knows the file the text came from.
+        save,
+    };
+
+    static constexpr int command_count = int(Command::save) + 1;
+
+    std::array<bool, command_count> commands {};
+
+    // Text typed during this frame, UTF-8.
+    std::string text;
+
+    // In window coordinates.
+    Vec2 mouse_pos = { 0.0f, 0.0f };
+    bool mouse_pressed = false;
+    bool mouse_down = false;
+    bool mouse_released = false;
+
+    // A mouse press adds a cursor instead of moving the cursor there.
+    bool mouse_adds_cursor = false;
+
+    // Lines scrolled during this frame, positive is up.
+    float wheel = 0.0f;
+
+    const KeyState& key(Key key) const { return keys[int(key)]; }
+    KeyState& key(Key key) { return keys[int(key)]; }
+
+    bool command(Command command) const { return commands[int(command)]; }
+    bool& command(Command command) { return commands[int(command)]; }
+
+    // Input that changes the view from one frame to the next for as long
+    // as it lasts: held down keys that repeat, dragging and scrolling.
+    bool is_active() const
+    {
+        for (const KeyState& state : keys)
+        {
+            if (state.down)
+                return true;
+        }
+
+        return mouse_down || wheel != 0.0f;
+    }
+};
+
+} // namespace zest
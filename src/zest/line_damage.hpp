@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace zest
+{
+
+// Lines of the view that have to be redrawn in the next frame. Lines are
+// given as line numbers of the text, only the ones inside the view are
+// remembered, the rest is not drawn anyway.
+class LineDamage
+{
+public:
+    int first_line() const { return first_line_; }
+    int line_count() const { return int(dirty_.size()); }
+
+    // Moves the view. When it actually moved everything has to be redrawn.
+    void set_view(int first_line, int line_count)
+    {
+        if (first_line == first_line_ && line_count == int(dirty_.size()))
+            return;
+
+        first_line_ = first_line;
+        dirty_.assign(line_count, 0);
+        mark_all();
+    }
+
+    void mark(int line)
+    {
+        mark(line, line + 1);
+    }
+
+    // Marks the lines in [first, last).
+    void mark(int first, int last)
+    {
+        first = std::max(first, first_line_) - first_line_;
+        last = std::min(last - first_line_, int(dirty_.size()));
+
+        for (int i = first; i < last; ++i)
+            dirty_[i] = 1;
+        if (first < last)
+            any_ = true;
+    }
+
+    void mark_all()
+    {
+        std::fill(dirty_.begin(), dirty_.end(), 1);
+        any_ = !dirty_.empty();
+    }
+
+    bool is_dirty(int line) const
+    {
+        int i = line - first_line_;
+        return i >= 0 && i < int(dirty_.size()) && dirty_[i];
+    }
+
+    bool any() const { return any_; }
+
+    void clear()
+    {
+        std::fill(dirty_.begin(), dirty_.end(), 0);
+        any_ = false;
+    }
+
+private:
+    int first_line_ = 0;
+    std::vector<uint8_t> dirty_;
+    bool any_ = false;
+};
+
+} // namespace zest
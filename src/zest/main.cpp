@@ -1,591 +1,679 @@
 #include <zest/app.hpp>
+#include <zest/editor.hpp>
+#include <zest/input.hpp>
+#include <zest/profile.hpp>
 #include <zest/raylib_wrapper.hpp>
+#include <zest/save_file.hpp>
 #include <zest/text.hpp>
-#include <zest/tree_sitter.hpp>
 #include <zest/types.hpp>
+#include <zest/highlight/cache.hpp>
 #include <zest/highlight/captures.hpp>
-#include <zest/highlight/queries.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <optional>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 
-zest::CellPos window_to_cursor_pos(Editor& editor,
-                                   LineBuffer& line_buffer,
-                                   zest::Vec2 pos)
+void append_utf8(std::string& text, int codepoint)
 {
-    pos.x += editor.file_space_x - editor.top_left_x;
-    pos.y += editor.file_space_y - editor.top_left_y;
-
-    int col = std::round(pos.x/editor.cell_width);
-    int row = pos.y/editor.cell_height;
-
-    if (col > line_buffer.get_line(row).size())
-        col = line_buffer.get_line(row).size();
-
-    if (row >= line_buffer.line_count())
-        row = line_buffer.line_count();
-
-    return { row, col };
+    if (codepoint < 0x80)
+    {
+        text += char(codepoint);
+    }
+    else if (codepoint < 0x800)
+    {
+        text += char(0xc0 | (codepoint >> 6));
+        text += char(0x80 | (codepoint & 0x3f));
+    }
+    else if (codepoint < 0x10000)
+    {
+        text += char(0xe0 | (codepoint >> 12));
+        text += char(0x80 | ((codepoint >> 6) & 0x3f));
+        text += char(0x80 | (codepoint & 0x3f));
+    }
+    else
+    {
+        text += char(0xf0 | (codepoint >> 18));
+        text += char(0x80 | ((codepoint >> 12) & 0x3f));
+        text += char(0x80 | ((codepoint >> 6) & 0x3f));
+        text += char(0x80 | (codepoint & 0x3f));
+    }
 }
 
-zest::CellPos window_to_cell_pos(Editor& editor,
-                                 LineBuffer& line_buffer,
-                                 zest::Vec2 pos)
+// The input of this frame, as raylib saw it in the last poll.
+zest::InputState poll_input()
 {
-    pos.x += editor.file_space_x - editor.top_left_x;
-    pos.y += editor.file_space_y - editor.top_left_y;
+    using Key = zest::InputState::Key;
+
+    zest::InputState input;
+
+    std::pair<Key, int> keys[] = {
+        { Key::left, KEY_LEFT },
+        { Key::right, KEY_RIGHT },
+        { Key::up, KEY_UP },
+        { Key::down, KEY_DOWN },
+        { Key::backspace, KEY_BACKSPACE },
+        { Key::del, KEY_DELETE },
+        { Key::enter, KEY_ENTER },
+    };
+    for (auto [key, raylib_key] : keys)
+    {
+        input.key(key).pressed = IsKeyPressed(raylib_key);
+        input.key(key).down = IsKeyDown(raylib_key);
+    }
 
-    int col = pos.x/editor.cell_width;
-    int row = pos.y/editor.cell_height;
+    for (int codepoint = GetCharPressed();
+         codepoint != 0;
+         codepoint = GetCharPressed())
+    {
+        append_utf8(input.text, codepoint);
+    }
 
-    if (col > line_buffer.get_line(row).size())
-        col = line_buffer.get_line(row).size();
+    using Command = zest::InputState::Command;
+
+    bool control = IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL);
+    bool alt = IsKeyDown(KEY_LEFT_ALT) || IsKeyDown(KEY_RIGHT_ALT);
+    input.command(Command::find) = control && IsKeyPressed(KEY_F);
+    input.command(Command::find_next) = IsKeyPressed(KEY_F3);
+    input.command(Command::cancel) = IsKeyPressed(KEY_ESCAPE);
+    input.command(Command::toggle_regex) = alt && IsKeyPressed(KEY_R);
+
+    bool shift = IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT);
+    input.command(Command::undo) = control && !shift && IsKeyPressed(KEY_Z);
+    input.command(Command::redo) =
+        control && (IsKeyPressed(KEY_Y) || (shift && IsKeyPressed(KEY_Z)));
+    input.command(Command::select_all_matches) =
+        control && shift && IsKeyPressed(KEY_L);
+    input.command(Command::save) = control && IsKeyPressed(KEY_S);
+
+    // Some platforms still report the letter of a shortcut as typed.
+    if (input.command(Command::find) || input.command(Command::toggle_regex)
+        || input.command(Command::undo) || input.command(Command::redo)
+        || input.command(Command::select_all_matches)
+        || input.command(Command::save))
+    {
+        input.text.clear();
+    }
 
-    if (row >= line_buffer.line_count())
-        row = line_buffer.line_count();
+    input.mouse_pos = zest::zestify(GetMousePosition());
+    input.mouse_pressed = IsMouseButtonPressed(MOUSE_BUTTON_LEFT);
+    input.mouse_down = IsMouseButtonDown(MOUSE_BUTTON_LEFT);
+    input.mouse_released = IsMouseButtonReleased(MOUSE_BUTTON_LEFT);
+    input.mouse_adds_cursor = alt;
+    input.wheel = GetMouseWheelMove();
 
-    return { row, col };
+    return input;
 }
 
-bool move_cursor_up(CursorState& cursor, const LineBuffer& line_buffer)
+// Uploads the bands of the image covering the dirty lines. The rows of a
+// band are contiguous in the image, so they go to the texture as they are.
+void upload_damage(Editor& editor, Texture2D texture)
 {
-    if (cursor.line == 0)
-        return false;
+    zest::profile::ScopedTimer timer(zest::profile::Stage::upload);
 
-    cursor.line--;
-    cursor.col = std::min((size_t)cursor.original_col,
-                          line_buffer.get_line(cursor.line).size());
+    const zest::LineDamage& damage = editor.damage;
+    const uint8_t* pixels = editor.text_area_pixels.data();
+    size_t stride = size_t(editor.width)*4;
 
-    return true;
-}
+    int row = damage.first_line();
+    int end = row + damage.line_count();
+    while (row < end)
+    {
+        if (!damage.is_dirty(row))
+        {
+            row++;
+            continue;
+        }
 
-bool move_cursor_down(CursorState& cursor, const LineBuffer& line_buffer)
-{
-    if (cursor.line > line_buffer.line_count() - 1)
-        return false;
+        int first = row;
+        while (row < end && damage.is_dirty(row))
+            row++;
 
-    cursor.line++;
-    cursor.col = std::min((size_t)cursor.original_col,
-                          line_buffer.get_line(cursor.line).size());
+        int top = std::max(0,
+            int(first*editor.cell_height - editor.file_space_y));
+        int bot = std::min(editor.height,
+            int(row*editor.cell_height - editor.file_space_y));
+        if (top >= bot)
+            continue;
 
-    return true;
+        UpdateTextureRec(texture,
+                         { 0, float(top),
+                           float(editor.width), float(bot - top) },
+                         pixels + top*stride);
+    }
 }
 
-bool move_cursor_left(CursorState& cursor, const LineBuffer& line_buffer)
+// Adds the quads of a single line for the GPU renderer. Every byte gets
+// the color of the last thing covering it, in the same order the CPU
+// renderer draws them: plain text, matches, selections, highlights.
+void draw_line_gpu(zest::raylib::GpuText& gpu_text,
+                   LineBuffer& line_buffer, CursorState& cursor,
+                   Editor& editor, int row, std::vector<zest::Color>& colors)
 {
-    if (cursor.col == 0)
-    {
-        bool has_moved = move_cursor_up(cursor, line_buffer);
-        if (has_moved)
-        {
-            cursor.col = line_buffer.get_line(cursor.line).size();
-            cursor.original_col = cursor.col;
-        }
-        return has_moved;
-    }
+    if (size_t(row) >= line_buffer.line_count())
+        return;
 
-    cursor.col--;
-    cursor.original_col = cursor.col;
+    float y = row*editor.cell_height - editor.file_space_y;
 
-    return true;
-}
+    int first_col = editor.file_space_x/editor.cell_width;
+    float x = first_col*editor.cell_width - editor.file_space_x;
 
-bool move_cursor_right(CursorState& cursor, const LineBuffer& line_buffer)
-{
-    if (cursor.col == line_buffer.get_line(cursor.line).size())
+    std::string_view line = line_buffer.get_line(row);
+    colors.assign(line.size(), Editor::text_color);
+
+    if (!editor.search.matches.empty())
     {
-        bool has_moved = move_cursor_down(cursor, line_buffer);
-        if (has_moved)
+        zest::profile::ScopedTimer timer(zest::profile::Stage::selection);
+
+        std::vector<std::pair<int, int>> columns;
+        matched_columns(editor, line_buffer.offset_of({ row, 0 }),
+                        line.size(), columns);
+
+        for (auto [from, to] : columns)
         {
-            cursor.col = 0;
-            cursor.original_col = cursor.col;
+            gpu_text.add_rect(
+                { from*editor.cell_width - editor.file_space_x, y,
+                  (to - from)*editor.cell_width, editor.cell_height },
+                Editor::match_color);
+            std::fill(colors.begin() + from, colors.begin() + to,
+                      Editor::matched_text_color);
         }
-        return has_moved;
     }
 
-    cursor.col++;
-    cursor.original_col = cursor.col;
+    int from, to, added_len;
+    if (editor.selection_valid
+        && selected_columns(editor, row, line.size(), from, to, added_len))
+    {
+        zest::profile::ScopedTimer timer(zest::profile::Stage::selection);
 
-    return true;
-}
+        gpu_text.add_rect(
+            { from*editor.cell_width - editor.file_space_x, y,
+              (to - from + added_len)*editor.cell_width, editor.cell_height },
+            Editor::selection_color);
 
-void stop_cursor(CursorState& cursor)
-{
-    cursor.state_down.active = false;
-    cursor.state_up.active = false;
-    cursor.state_right.active = false;
-    cursor.state_left.active = false;
-}
+        int len = line.size();
+        std::fill(colors.begin() + std::min(from, len),
+                  colors.begin() + std::min(to, len),
+                  Editor::selected_text_color);
+    }
 
-template<typename MoveFunc>
-void update_cursor_direction(LineBuffer& line_buffer,
-                             CursorState& cursor,
-                             Editor& editor,
-                             MoveFunc move, int key,
-                             CursorState::MoveState& state,
-                             double time_delta)
-{
-    auto move_cursor = [&] ()
+    auto [first_extra, last_extra] = extra_cursors_on_row(editor, row);
+    for (size_t i = first_extra; i < last_extra; ++i)
     {
-        bool has_moved = move(cursor, line_buffer);
-        if (has_moved)
+        const ExtraCursor& extra = editor.extra_cursors[i];
+        if (extra.pos == extra.anchor
+            || !range_columns(extra.start(), extra.end(), row, line.size(),
+                              from, to, added_len))
         {
-            cursor.time = 0;
-            cursor.visible = true;
+            continue;
         }
-    };
 
-    if (IsKeyPressed(key))
-    {
-        stop_cursor(cursor);
-        move_cursor();
-        state.down_time = cursor.move_rate - cursor.initial_delay;
-        state.active = true;
+        zest::profile::ScopedTimer timer(zest::profile::Stage::selection);
+
+        gpu_text.add_rect(
+            { from*editor.cell_width - editor.file_space_x, y,
+              (to - from + added_len)*editor.cell_width, editor.cell_height },
+            Editor::selection_color);
 
-        editor.cursorize_view = true;
+        int len = line.size();
+        std::fill(colors.begin() + std::min(from, len),
+                  colors.begin() + std::min(to, len),
+                  Editor::selected_text_color);
     }
-    else if (IsKeyDown(key) && state.active)
+
+    zest::highlight::SpanCache& cache = editor.highlight_cache;
+    if (editor.tree && size_t(row) < cache.line_count())
     {
-        state.down_time += time_delta;
-        if (state.down_time >= cursor.move_rate)
+        for (const zest::highlight::Span& span : cache.spans(row))
         {
-            move_cursor();
-            state.down_time -= cursor.move_rate;
+            size_t end = std::min<size_t>(span.end_col, line.size());
+            if (span.start_col < end)
+                std::fill(colors.begin() + span.start_col,
+                          colors.begin() + end,
+                          zest::highlight::highlights[span.color].color);
         }
-
-        editor.cursorize_view = true;
     }
-}
-
-void set_cursor_to_mouse(CursorState& cursor,
-                         Editor& editor,
-                         LineBuffer& line_buffer)
-{
-    zest::Vec2 mouse_pos = zest::zestify(GetMousePosition());
-
-    if (!zest::is_inside(mouse_pos, editor.text_area_rect))
-        return;
 
-    zest::CellPos cell_pos = window_to_cursor_pos(editor, line_buffer,
-                                                  mouse_pos);
+    if (size_t(first_col) < line.size())
+        gpu_text.add_text(x, y, line.substr(first_col),
+                          colors.data() + first_col);
 
-    cursor.col = cell_pos.col;
-    cursor.original_col = cursor.col;
-    cursor.line = cell_pos.line;
+    if (cursor.visible && cursor.line == row)
+        gpu_text.add_rect(
+            { cursor.col*editor.cell_width - editor.file_space_x, y,
+              2, editor.cell_height },
+            Editor::cursor_color);
 
-    cursor.visible = true;
-    cursor.time = 0;
+    for (size_t i = first_extra; cursor.visible && i < last_extra; ++i)
+    {
+        zest::CellPos pos = editor.extra_cursors[i].pos;
+        if (pos.line == row)
+            gpu_text.add_rect(
+                { pos.col*editor.cell_width - editor.file_space_x, y,
+                  2, editor.cell_height },
+                Editor::cursor_color);
+    }
 }
 
-void set_file_view_to_cursor(CursorState& cursor, Editor& editor)
+// Percentiles of the stages in the top right corner of the window. The
+// times are from the frames before this one.
+void draw_profile_overlay()
 {
-    zest::Rect cursor_cell = {
-        float(cursor.col*editor.font_info.char_step),
-        float(cursor.line*editor.font_info.font_size),
-        editor.font_info.char_step,
-        float(editor.font_info.font_size)
-    };
+    int font_size = 10;
+    int line_height = font_size + 2;
+    int width = 220;
+    int x = GetScreenWidth() - width - 4;
+    int y = 4;
 
-    if (zest::get_top(cursor_cell) < editor.file_space_y)
-        editor.file_space_y = cursor_cell.y;
+    int height = (zest::profile::stage_count + 1)*line_height + 4;
+    DrawRectangle(x, y, width, height, Fade(BLACK, 0.75f));
 
-    if (zest::get_bot(cursor_cell) > editor.file_space_y + editor.height)
-        editor.file_space_y = zest::get_bot(cursor_cell) - editor.height;
+    DrawText("stage           p50 ms    p99 ms", x + 4, y + 2, font_size,
+             WHITE);
 
-    if (zest::get_left(cursor_cell) < editor.file_space_x)
-        editor.file_space_x = zest::get_left(cursor_cell);
-
-    if (zest::get_right(cursor_cell) > editor.file_space_x + editor.width)
-        editor.file_space_x = zest::get_right(cursor_cell) - editor.width;
-
-    editor.view_rect.x = editor.file_space_x;
-    editor.view_rect.y = editor.file_space_y;
-}
-
-void update_selection(Editor& editor, LineBuffer& line_buffer)
-{
-    zest::Vec2 mouse_pos = zest::zestify(GetMousePosition());
-
-    if (is_inside(mouse_pos, editor.text_area_rect)
-        && IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
-    {
-        editor.selecting = true;
-        editor.selection_valid = true;
-        editor.selection_origin =
-            window_to_cursor_pos(editor, line_buffer, mouse_pos);
-        editor.selection_current = editor.selection_origin;
-    }
-
-    if (editor.selecting)
+    char text[64];
+    for (int i = 0; i < zest::profile::stage_count; ++i)
     {
-        if (IsMouseButtonDown(MOUSE_BUTTON_LEFT))
-            editor.selection_current =
-                window_to_cursor_pos(editor, line_buffer, mouse_pos);
+        zest::profile::Stage stage = zest::profile::Stage(i);
+        zest::profile::StageStats stats = zest::profile::stats(stage);
 
-        if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT))
-            editor.selecting = false;
+        std::snprintf(text, sizeof(text), "%-12s %9.3f %9.3f",
+                      zest::profile::stage_name(stage),
+                      stats.p50_ms, stats.p99_ms);
+        DrawText(text, x + 4, y + 2 + (i + 1)*line_height, font_size, WHITE);
     }
 }
 
+// The query and the number of matches in the margin under the text area,
+// or why the query is not a valid regex.
+void draw_search_bar(const Editor& editor)
+{
+    const SearchState& search = editor.search;
+
+    char count[64];
+    std::snprintf(count, sizeof(count), "%zu match%s%s",
+                  search.matches.size(),
+                  search.matches.size() == 1 ? "" : "es",
+                  search.search ? ", searching..." : "");
+
+    std::string text = (search.regex ? "Regex: " : "Find: ") + search.query
+                       + "_   (" + (search.error.empty() ? count
+                                                         : search.error)
+                       + ")   Alt+R: regex";
+    DrawText(text.c_str(), editor.top_left_x,
+             editor.top_left_y + editor.height + 4, 10, WHITE);
+}
 
-void update(LineBuffer& line_buffer, CursorState& cursor, Editor& editor,
-            double time_delta)
+void draw(LineBuffer& line_buffer, App& app)
 {
-    update_cursor_direction(line_buffer, cursor, editor, move_cursor_left,
-                            KEY_LEFT, cursor.state_left, time_delta);
-    update_cursor_direction(line_buffer, cursor, editor, move_cursor_right,
-                            KEY_RIGHT, cursor.state_right, time_delta);
-    update_cursor_direction(line_buffer, cursor, editor, move_cursor_up,
-                            KEY_UP, cursor.state_up, time_delta);
-    update_cursor_direction(line_buffer, cursor, editor, move_cursor_down,
-                            KEY_DOWN, cursor.state_down, time_delta);
-
-    if (editor.cursorize_view)
-        set_file_view_to_cursor(cursor, editor);
-    editor.cursorize_view = false;
-
-    if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)
-        || IsMouseButtonDown(MOUSE_BUTTON_LEFT))
-    {
-        set_cursor_to_mouse(cursor, editor, line_buffer);
-    }
+    Editor& editor = app.editor;
+    CursorState& cursor = app.cursor;
 
-    cursor.time += time_delta;
-    if (cursor.time >= cursor.blink_time)
-    {
-        cursor.time -= cursor.blink_time;
-        cursor.visible = !cursor.visible;
-    }
+    int first_row, last_row;
+    visible_rows(editor, first_row, last_row);
 
-    editor.file_space_y += -GetMouseWheelMove()*editor.cell_height;
-    editor.view_rect.y = editor.file_space_y;
+    if (app.gpu_text)
+    {
+        update_highlights(editor, first_row, last_row);
 
-    if (editor.file_space_y < 0)
-        editor.file_space_y = 0;
+        app.gpu_text->clear();
+        app.gpu_text->add_rect(
+            { 0, 0, (float)editor.width, (float)editor.height },
+            Editor::background_color);
 
-    float file_bot = (line_buffer.line_count() - 1) * editor.cell_height;
-    if (editor.file_space_y >= file_bot)
-        editor.file_space_y = file_bot;
+        zest::profile::ScopedTimer timer(zest::profile::Stage::rasterize);
 
-    // Set the mouse cursor to correct image
-    zest::Vec2 mouse_pos = zest::zestify(GetMousePosition());
-    if (mouse_pos.x >= editor.top_left_x
-        && mouse_pos.x <= editor.top_left_x + editor.width
-        && mouse_pos.y >= editor.top_left_y
-        && mouse_pos.y <= editor.top_left_y + editor.height)
-    {
-        SetMouseCursor(MOUSE_CURSOR_IBEAM);
+        std::vector<zest::Color> colors;
+        for (int i = first_row; i <= last_row; ++i)
+            draw_line_gpu(*app.gpu_text, line_buffer, cursor, editor, i,
+                          colors);
     }
     else
     {
-        SetMouseCursor(MOUSE_CURSOR_DEFAULT);
+        update_damage(cursor, editor, first_row, last_row);
+        update_highlights(editor, first_row, last_row);
+
+        if (editor.damage.any())
+        {
+            draw_damage(line_buffer, cursor, editor, first_row, last_row);
+            upload_damage(editor, app.text_area_texture);
+            editor.damage.clear();
+        }
     }
 
-    update_selection(editor, line_buffer);
-}
+    BeginDrawing();
+        ClearBackground(BLACK);
+        if (app.gpu_text)
+            app.gpu_text->draw(
+                { (float)editor.top_left_x, (float)editor.top_left_y },
+                editor.text_area_rect);
+        else
+            DrawTexture(app.text_area_texture,
+                        editor.top_left_x, editor.top_left_y, WHITE);
 
+        DrawRectangleLines(editor.top_left_x - 1, editor.top_left_y - 1,
+                           editor.width + 2, editor.height + 2,
+                           RED);
 
+        zest::Vec2 mouse_pos = zest::zestify(GetMousePosition());
+        DrawRectangle(mouse_pos.x, mouse_pos.y, 2, 2, RED);
 
-void draw_clipped_rectangle(Image& img,
-                            const zest::Rect& image_rect,
-                            const zest::Rect& target_rect,
-                            Color color)
-{
-    zest::Rect rect = zest::clip_rect_to_fit(image_rect, target_rect);
+        if (editor.search.active)
+            draw_search_bar(editor);
 
-    if (rect.width == 0 || rect.height == 0)
-        return;
+        if (zest::profile::is_enabled())
+            draw_profile_overlay();
 
-    zest::raylib::draw_rectangle(img, rect, color);
+    zest::profile::ScopedTimer timer(zest::profile::Stage::present);
+    EndDrawing();
 }
 
-void draw_text_segment(Image* image,
-                       const char* text,
-                       int from, int to,
-                       zest::Vec2 pos,
-                       const FontInfo& font_info,
-                       std::vector<char>& buffer,
-                       Color text_color,
-                       std::optional<Color> bg_color)
-{
-    if (from >= to)
-        return;
-
-    int n = to - from;
 
-    if (buffer.size() < n + 1)
-        buffer.resize(n + 1);
-
-    std::memcpy(buffer.data(), text + from, n);
-    buffer[n] = 0;
-
-    if (bg_color)
-        ImageDrawRectangle(image, pos.x, pos.y, n*font_info.char_step,
-                           font_info.font_size, *bg_color);
-
-    ImageDrawTextEx(image, font_info.font, buffer.data(), { pos.x, pos.y },
-                    font_info.font_size, font_info.char_spacing, text_color);
-}
+enum class FramePacing
+{
+    // A frame every 1/60 s, whether anything changed or not.
+    fixed,
 
+    // Frames only when something on screen changed. Input is still polled
+    // in between, raylib has no way to wait for it with a timeout.
+    on_demand,
+};
 
-void draw_node(Editor& editor, LineBuffer& line_buff, TSNode node,
-               zest::Color color)
+// Everything a frame shows, compared between loop iterations to find out
+// whether a new frame is needed at all.
+struct FrameState
 {
-    TSPoint start = ts_node_start_point(node);
-    TSPoint end = ts_node_end_point(node);
-
-    if (end.row != start.row)
-    {
-        //std::cout << ts_node_type(node) << "\n";
-        std::cerr << "PANIC!\n";
-        return;
-    }
+    float file_space_x;
+    float file_space_y;
 
-    uint32_t len = end.column - start.column;
+    int cursor_line;
+    int cursor_col;
+    bool cursor_visible;
 
-    zest::Rect node_rect = {
-        start.column*editor.cell_width,
-        start.row*editor.cell_height,
-        len*editor.cell_width,
-        editor.cell_height
-    };
+    bool selection_valid;
+    zest::CellPos selection_origin;
+    zest::CellPos selection_current;
 
-    std::vector<char> buffer(len + 1, 0);
-    std::memcpy(buffer.data(),
-                line_buff.get_line(start.row).c_str() + start.column,
-                len);
+    uint64_t cursors_version;
+    uint64_t search_version;
 
-    if (!zest::are_intersecting(node_rect, editor.view_rect))
-        return;
+    uint64_t edit_version;
+    const TSTree* tree;
 
-    float x = node_rect.x - editor.view_rect.x;
-    float y = node_rect.y - editor.view_rect.y;
+    zest::Vec2 mouse_pos;
+};
 
-    ImageDrawTextEx(&editor.text_area_image,
-                    editor.font_info.font,
-                    buffer.data(),
-                    { x, y },
-                    editor.font_info.font_size,
-                    editor.font_info.char_spacing,
-                    zest::raylib::to_raylib(color));
+FrameState frame_state(const CursorState& cursor, const Editor& editor,
+                       const zest::InputState& input)
+{
+    return {
+        editor.file_space_x,
+        editor.file_space_y,
+        cursor.line,
+        cursor.col,
+        cursor.visible,
+        editor.selection_valid,
+        editor.selection_origin,
+        editor.selection_current,
+        editor.cursors_version,
+        editor.search.version,
+        editor.edit_log_base + editor.edit_log.size(),
+        editor.tree.get(),
+        input.mouse_pos
+    };
 }
 
-void draw_highlights(Editor& editor, LineBuffer& line_buff)
+bool operator!=(const FrameState& lhs, const FrameState& rhs)
 {
-    zest::tree_sitter::TreePtr tree =
-        zest::tree_sitter::parse_text(editor.parser.get(), line_buff);
+    return lhs.file_space_x != rhs.file_space_x
+           || lhs.file_space_y != rhs.file_space_y
+           || lhs.cursor_line != rhs.cursor_line
+           || lhs.cursor_col != rhs.cursor_col
+           || lhs.cursor_visible != rhs.cursor_visible
+           || lhs.selection_valid != rhs.selection_valid
+           || lhs.selection_origin != rhs.selection_origin
+           || lhs.selection_current != rhs.selection_current
+           || lhs.cursors_version != rhs.cursors_version
+           || lhs.search_version != rhs.search_version
+           || lhs.edit_version != rhs.edit_version
+           || lhs.tree != rhs.tree
+           || lhs.mouse_pos.x != rhs.mouse_pos.x
+           || lhs.mouse_pos.y != rhs.mouse_pos.y;
+}
 
-    TSNode root = ts_tree_root_node(tree.get());
+struct Options
+{
+    std::string file_path = "../main.cpp";
+    Renderer renderer = Renderer::cpu;
+    FramePacing frame_pacing = FramePacing::on_demand;
 
-    ts_query_cursor_exec(editor.query_cursor.get(),
-                         editor.queries.get(),
-                         root);
+    // Shows the stage timings over the text.
+    bool profile = false;
 
-    TSQueryMatch match;
-    uint32_t capture_idx;
+    // Where the Chrome trace of the run goes, none when empty.
+    std::string trace_path;
+};
 
-    while (ts_query_cursor_next_capture(editor.query_cursor.get(),
-                                        &match, &capture_idx))
-    {
-        const TSQueryCapture& capture = match.captures[capture_idx];
+std::optional<Options> parse_options(int argc, char** argv)
+{
+    Options options;
 
-        uint32_t name_len;
-        const char* capture_name =
-            ts_query_capture_name_for_id(editor.queries.get(),
-                                         capture.index,
-                                         &name_len);
-        std::string_view capture_view(capture_name, name_len);
+    if (const char* profile = std::getenv("ZEST_PROFILE"))
+        options.profile = *profile != '\0' && *profile != '0';
+    if (const char* trace_path = std::getenv("ZEST_TRACE"))
+        options.trace_path = trace_path;
 
-        //std::cout << capture_view << "\n";
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view arg = argv[i];
 
-        auto it = zest::highlight::highlights.find(capture_view);
-        if (it == zest::highlight::highlights.end())
+        if (arg == "--renderer=cpu")
         {
-            std::cerr << "Capture not found!\n";
-            continue;
+            options.renderer = Renderer::cpu;
+        }
+        else if (arg == "--renderer=gpu")
+        {
+            options.renderer = Renderer::gpu;
+        }
+        else if (arg == "--frame-pacing=fixed")
+        {
+            options.frame_pacing = FramePacing::fixed;
+        }
+        else if (arg == "--frame-pacing=on-demand")
+        {
+            options.frame_pacing = FramePacing::on_demand;
+        }
+        else if (arg == "--profile")
+        {
+            options.profile = true;
+        }
+        else if (arg.substr(0, 8) == "--trace=")
+        {
+            options.trace_path = arg.substr(8);
+        }
+        else if (arg.substr(0, 2) == "--")
+        {
+            std::cerr << "Unknown option '" << arg << "'\n"
+                      << "Usage: " << argv[0]
+                      << " [--renderer=cpu|gpu]"
+                         " [--frame-pacing=fixed|on-demand]"
+                         " [--profile] [--trace=file] [file]\n";
+            return std::nullopt;
+        }
+        else
+        {
+            options.file_path = arg;
         }
-
-        zest::Color color = it->second;
-        draw_node(editor, line_buff, capture.node, color);
     }
+
+    return options;
 }
 
-void draw_selection(LineBuffer& line_buffer, CursorState& cursor, Editor& editor)
+int main(int argc, char** argv)
 {
-    zest::Rect img_rect = {
-        0, 0, editor.text_area_rect.width, editor.text_area_rect.height
-    };
-
-    zest::CellPos selection_start = editor.selection_origin;
-    zest::CellPos selection_end = editor.selection_current;
-    if (editor.selection_origin.line > editor.selection_current.line
-        || (editor.selection_origin.line == editor.selection_current.line
-            && editor.selection_origin.col >= editor.selection_current.col))
-    {
-        std::swap(selection_start, selection_end);
-    }
-
-    std::vector<char> buffer;
-
-    for (int i = selection_start.line; i <= selection_end.line; ++i)
-    {
-        int line_len = (int)line_buffer.get_line(i).size();
-
-        int from = i == selection_start.line
-                        ? selection_start.col
-                        : 0;
-        int to = i == selection_end.line
-                        ? selection_end.col
-                        : line_len;
+    auto launch_time = std::chrono::steady_clock::now();
 
-        int n = to - from;
+    std::optional<Options> options = parse_options(argc, argv);
+    if (!options)
+        return 1;
 
-        float x = from*editor.cell_width - editor.file_space_x;
-        float y = i*editor.cell_height - editor.file_space_y;
+    if (options->profile)
+        zest::profile::enable();
+    if (!options->trace_path.empty())
+        zest::profile::enable_trace();
 
-        int added_len = selection_end.line > selection_start.line
-                        && i != selection_end.line
-                            ? 1
-                            : 0;
+    LineBuffer line_buffer = load_file(options->file_path);
 
-        draw_clipped_rectangle(
-            editor.text_area_image,
-            img_rect,
-            { x, y, (n + added_len)*editor.cell_width, editor.cell_height },
-            WHITE);
-
-        if (n == 0)
-            continue;
-
-        if (buffer.size() < n + 1)
-            buffer.resize(n + 1);
+    double target_frame_time = 1.0/60.0;
 
-        std::memcpy(buffer.data(), &line_buffer.get_line(i)[from], n);
-        buffer[n] = 0;
+    int window_width = 800;
+    int window_height = 450;
 
-        ImageDrawTextEx(&editor.text_area_image,
-                        editor.font_info.font,
-                        buffer.data(),
-                        { x, y },
-                        editor.font_info.font_size,
-                        editor.font_info.char_spacing,
-                        BLACK);
-    }
-}
+    SetTraceLogLevel(LOG_WARNING);
+    SetConfigFlags(FLAG_WINDOW_HIGHDPI | FLAG_WINDOW_RESIZABLE);
+    InitWindow(window_width, window_height, "edwin");
 
-void draw(LineBuffer& line_buffer, CursorState& cursor, Editor& editor)
-{
-    int font_size = editor.font_info.font_size;
+    // Escape closes the search bar instead of the window.
+    SetExitKey(KEY_NULL);
 
-    ImageClearBackground(&editor.text_area_image, BLUE);
+    App app = init_app(window_width, window_height, options->renderer);
+    app.editor.highlight_cache.reset(line_buffer.line_count());
 
-    int first_row = editor.file_space_y/font_size;
-    int last_row = (editor.file_space_y + editor.height)/font_size;
-    int rows = line_buffer.line_count();
+    // While keys repeat or the view scrolls, frames follow the display
+    // instead of the 60 Hz the input is polled at otherwise.
+    int refresh_rate = GetMonitorRefreshRate(GetCurrentMonitor());
+    double active_frame_time = 1.0/std::max(refresh_rate, 60);
 
-    int first_col = editor.file_space_x/editor.cell_width;
+    bool first_frame = true;
+    FrameState drawn_state {};
 
-    float x = first_col*editor.cell_width - editor.file_space_x;
-    float y = first_row*font_size - editor.file_space_y;
+    // Time spent in draw, to compare the renderers.
+    double draw_time = 0.0;
+    long frame_count = 0;
+    long iteration_count = 0;
 
-    for (int i = first_row; i <= last_row && i < rows; ++i)
+    double last_frame_time = 0.0f;
+    while (true)
     {
-        if (first_col < line_buffer.get_line(i).size())
-            ImageDrawTextEx(&editor.text_area_image,
-                            editor.font_info.font,
-                            &line_buffer.get_line(i)[first_col],
-                            { x, y },
-                            font_size,
-                            editor.font_info.char_spacing,
-                            WHITE);
-        y += font_size;
-    }
+        if (WindowShouldClose())
+            break;
 
-    if (editor.selection_valid)
-        draw_selection(line_buffer, cursor, editor);
+        double start_time = GetTime();
+        iteration_count++;
 
-    if (cursor.visible)
-    {
-        float offset_x = cursor.col*editor.cell_width - editor.file_space_x;
-        float offset_y = cursor.line*editor.cell_height - editor.file_space_y;
-
-        if (offset_y > -editor.cell_height && offset_y < editor.height)
-            draw_clipped_rectangle(
-                editor.text_area_image,
-                { 0, 0,
-                  editor.text_area_rect.width, editor.text_area_rect.height  },
-                { offset_x, offset_y,
-                  2, (float)font_size },
-                WHITE);
-    }
+        bool resized = IsWindowResized();
+        if (resized)
+            resize_app(app,
+                       GetScreenWidth() - 2*app.editor.top_left_x,
+                       GetScreenHeight() - 2*app.editor.top_left_y);
 
-    draw_highlights(editor, line_buffer);
+        zest::InputState input = poll_input();
+        {
+            zest::profile::ScopedTimer timer(zest::profile::Stage::update);
+            update(line_buffer, app.cursor, app.editor, input,
+                   last_frame_time);
+            update_syntax_tree(app.editor, line_buffer);
+        }
 
-    Texture2D text_area_texture = LoadTextureFromImage(editor.text_area_image);
+        if (input.command(zest::InputState::Command::save))
+        {
+            auto save_start = std::chrono::steady_clock::now();
+            try
+            {
+                zest::save_file(line_buffer, options->file_path);
+
+                if (zest::profile::is_enabled())
+                {
+                    std::chrono::duration<double, std::milli> save_time =
+                        std::chrono::steady_clock::now() - save_start;
+                    std::cout << "Saved " << options->file_path << " in "
+                              << save_time.count() << " ms\n";
+                }
+            }
+            catch (const std::runtime_error& error)
+            {
+                std::cerr << error.what() << "\n";
+            }
+        }
 
-    BeginDrawing();
-        ClearBackground(BLACK);
-        DrawTexture(text_area_texture, editor.top_left_x, editor.top_left_y, WHITE);
+        SetMouseCursor(zest::is_inside(input.mouse_pos,
+                                       app.editor.text_area_rect)
+                           ? MOUSE_CURSOR_IBEAM
+                           : MOUSE_CURSOR_DEFAULT);
 
-        DrawRectangleLines(editor.top_left_x - 1, editor.top_left_y - 1,
-                           editor.width + 2, editor.height + 2,
-                           RED);
+        FrameState state = frame_state(app.cursor, app.editor, input);
+        bool render = options->frame_pacing == FramePacing::fixed
+                      || first_frame
+                      || resized
+                      || state != drawn_state
+                      || app.editor.damage.any();
 
-        zest::Vec2 mouse_pos = zest::zestify(GetMousePosition());
-        DrawRectangle(mouse_pos.x, mouse_pos.y, 2, 2, RED);
+        double frame_time = target_frame_time;
+        if (options->frame_pacing == FramePacing::on_demand)
+        {
+            frame_time = input.is_active() ? active_frame_time
+                                           : target_frame_time;
 
-    EndDrawing();
+            // Wakes up in time to blink.
+            if (!render)
+                frame_time = std::min(
+                    frame_time, app.cursor.blink_time - app.cursor.time);
+        }
 
-    UnloadTexture(text_area_texture);
-}
+        if (render)
+        {
+            zest::profile::ScopedTimer timer(zest::profile::Stage::frame);
 
+            double draw_start_time = GetTime();
+            draw(line_buffer, app);
+            draw_time += GetTime() - draw_start_time;
+            frame_count++;
+            drawn_state = state;
+        }
 
-int main(int argc, char** argv)
-{
-    std::string file_path;
-    if (argc < 2)
-        file_path = "../main.cpp";
-    else
-        file_path = argv[1];
-    LineBuffer line_buffer = load_file(file_path);
+        if (first_frame && zest::profile::is_enabled())
+        {
+            std::chrono::duration<double, std::milli> time_to_first_frame =
+                std::chrono::steady_clock::now() - launch_time;
+            const char* load = line_buffer.mapped_file() ? "mmap" : "read";
+            std::cout << "Time to first frame: " << time_to_first_frame.count()
+                      << " ms (" << load << " load)\n";
+        }
+        first_frame = false;
 
-    int fps = 30;
-    double target_frame_time = 1.0/60.0;
+        double elapsed = GetTime() - start_time;
+        if (elapsed < frame_time)
+            WaitTime(frame_time - elapsed);
 
-    int window_width = 800;
-    int window_height = 450;
+        // EndDrawing polls the input when there was a frame. Without one it
+        // is polled here, after the wait, so it is as fresh as it can be.
+        if (!render)
+            PollInputEvents();
 
-    SetTraceLogLevel(LOG_WARNING);
-    SetConfigFlags(FLAG_WINDOW_HIGHDPI);
-    InitWindow(window_width, window_height, "edwin");
+        last_frame_time = GetTime() - start_time;
+    }
 
-    App app = init_app(window_width, window_height);
+    if (frame_count > 0 && zest::profile::is_enabled())
+        std::cout << "Average draw time: " << draw_time/frame_count*1000
+                  << " ms over " << frame_count << " frames ("
+                  << (options->renderer == Renderer::gpu ? "gpu" : "cpu")
+                  << " renderer, " << iteration_count << " loop iterations)\n";
 
-    double last_frame_time = 0.0f;
-    while (true)
+    if (!options->trace_path.empty()
+        && zest::profile::write_trace(options->trace_path))
     {
-        if (WindowShouldClose())
-            break;
-
-        double start_time = GetTime();
-
-        update(line_buffer, app.cursor, app.editor, last_frame_time);
-        draw(line_buffer, app.cursor, app.editor);
-
-        double elapsed = GetTime() - start_time;
-        if (elapsed < target_frame_time)
-            WaitTime(target_frame_time - elapsed);
-
-        last_frame_time = GetTime() - start_time;
+        std::cout << "Trace written to " << options->trace_path << "\n";
     }
 
-    UnloadImage(app.editor.text_area_image);
-    UnloadFont(app.editor.font_info.font);
+    app.gpu_text.reset();
+    UnloadTexture(app.text_area_texture);
 
     CloseWindow();
 }
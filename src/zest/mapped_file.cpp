@@ -0,0 +1,110 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+using namespace zest;
+
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path)
+    : path_(path)
+{
+    // Lets other programs write, rename or delete the file while it is
+    // mapped.
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE
+                                  | FILE_SHARE_DELETE,
+                              NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Cannot open file '" + path + "'");
+    file_ = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        throw std::runtime_error("Cannot get size of file '" + path + "'");
+    }
+    size_ = size.QuadPart;
+
+    if (size_ == 0)
+        return;
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    void* view = mapping
+                    ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)
+                    : nullptr;
+    if (!view)
+    {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        throw std::runtime_error("Cannot map file '" + path + "'");
+    }
+
+    mapping_ = mapping;
+    data_ = (const char*)view;
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_)
+        UnmapViewOfFile(data_);
+    if (mapping_)
+        CloseHandle(mapping_);
+    if (file_)
+        CloseHandle(file_);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path)
+    : path_(path)
+{
+    fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0)
+        throw std::runtime_error("Cannot open file '" + path + "'");
+
+    struct stat info;
+    if (fstat(fd_, &info) != 0)
+    {
+        close(fd_);
+        throw std::runtime_error("Cannot get size of file '" + path + "'");
+    }
+    size_ = info.st_size;
+
+    if (size_ == 0)
+        return;
+
+    void* view = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (view == MAP_FAILED)
+    {
+        close(fd_);
+        throw std::runtime_error("Cannot map file '" + path + "'");
+    }
+
+    data_ = (const char*)view;
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_)
+        munmap((void*)data_, size_);
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+#endif
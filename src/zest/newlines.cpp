@@ -0,0 +1,145 @@
+#include "newlines.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ZEST_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+// Chunks smaller than this are not worth a thread of their own.
+static constexpr size_t min_chunk_size = 4*1024*1024;
+
+#ifdef ZEST_SSE2
+
+static unsigned count_trailing_zeros(uint64_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return index;
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+static uint64_t newline_mask(const char* data, __m128i newline)
+{
+    uint64_t m0 = _mm_movemask_epi8(_mm_cmpeq_epi8(
+        _mm_loadu_si128((const __m128i*)(data)), newline));
+    uint64_t m1 = _mm_movemask_epi8(_mm_cmpeq_epi8(
+        _mm_loadu_si128((const __m128i*)(data + 16)), newline));
+    uint64_t m2 = _mm_movemask_epi8(_mm_cmpeq_epi8(
+        _mm_loadu_si128((const __m128i*)(data + 32)), newline));
+    uint64_t m3 = _mm_movemask_epi8(_mm_cmpeq_epi8(
+        _mm_loadu_si128((const __m128i*)(data + 48)), newline));
+
+    return m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+}
+
+#endif
+
+static void scan_chunk(const char* data, size_t from, size_t to,
+                       std::vector<size_t>& newlines)
+{
+    size_t i = from;
+
+#ifdef ZEST_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+
+    for (; i + 64 <= to; i += 64)
+    {
+        uint64_t mask = newline_mask(data + i, newline);
+        while (mask)
+        {
+            newlines.push_back(i + count_trailing_zeros(mask));
+            mask &= mask - 1;
+        }
+    }
+#else
+    while (i < to)
+    {
+        const char* nl = (const char*)std::memchr(data + i, '\n', to - i);
+        if (!nl)
+            return;
+        newlines.push_back(nl - data);
+        i = nl - data + 1;
+    }
+#endif
+
+    for (; i < to; ++i)
+    {
+        if (data[i] == '\n')
+            newlines.push_back(i);
+    }
+}
+
+std::vector<size_t> zest::find_newlines(const char* data, size_t size,
+                                        unsigned threads)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    size_t chunk_count = std::min<size_t>(threads, size/min_chunk_size);
+
+    std::vector<size_t> newlines;
+    if (chunk_count <= 1)
+    {
+        scan_chunk(data, 0, size, newlines);
+        return newlines;
+    }
+
+    size_t chunk_size = size/chunk_count;
+    std::vector<std::vector<size_t>> partial(chunk_count);
+    std::vector<std::thread> workers;
+
+    // The calling thread scans the last chunk itself.
+    for (size_t i = 0; i < chunk_count; ++i)
+    {
+        size_t from = i*chunk_size;
+        size_t to = i + 1 == chunk_count ? size : from + chunk_size;
+
+        if (i + 1 == chunk_count)
+            scan_chunk(data, from, to, partial[i]);
+        else
+            workers.emplace_back(scan_chunk, data, from, to,
+                                 std::ref(partial[i]));
+    }
+
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+
+    std::vector<size_t> starts(chunk_count + 1, 0);
+    for (size_t i = 0; i < chunk_count; ++i)
+        starts[i + 1] = starts[i] + partial[i].size();
+
+    // Every partial table goes to its own slice of the result, so the
+    // merge is parallel as well.
+    newlines.resize(starts.back());
+
+    auto merge = [&] (size_t i)
+    {
+        std::copy(partial[i].begin(), partial[i].end(),
+                  newlines.begin() + starts[i]);
+        std::vector<size_t>().swap(partial[i]);
+    };
+
+    for (size_t i = 0; i + 1 < chunk_count; ++i)
+        workers.emplace_back(merge, i);
+    merge(chunk_count - 1);
+
+    for (std::thread& worker : workers)
+        worker.join();
+
+    return newlines;
+}
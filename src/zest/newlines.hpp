@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace zest
+{
+
+// Offsets of all the '\n' characters in [data, data + size), in ascending
+// order. Large inputs are split into chunks that are scanned in parallel
+// by up to `threads` workers, 0 means one per hardware thread.
+std::vector<size_t> find_newlines(const char* data, size_t size,
+                                  unsigned threads = 0);
+
+} // namespace zest
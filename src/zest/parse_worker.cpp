@@ -0,0 +1,121 @@
+#include "parse_worker.hpp"
+
+#include <zest/profile.hpp>
+
+
+using namespace zest::tree_sitter;
+
+
+// Tree-sitter polls the cancellation flag as a plain size_t.
+static_assert(sizeof(std::atomic<size_t>) == sizeof(size_t)
+              && std::atomic<size_t>::is_always_lock_free);
+
+ParseWorker::ParseWorker(ParserPtr parser, std::function<void()> on_result)
+    : on_result_(std::move(on_result)),
+      parser_(std::move(parser))
+{
+    ts_parser_set_cancellation_flag(parser_.get(),
+                                    (const size_t*)&cancel_flag_);
+    thread_ = std::thread(&ParseWorker::run, this);
+}
+
+ParseWorker::~ParseWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        cancel_flag_ = 1;
+    }
+    wake_.notify_one();
+    thread_.join();
+
+    delete result_.exchange(nullptr);
+}
+
+void ParseWorker::submit(TextSnapshot snapshot,
+                         std::vector<zest::TextEdit> edits,
+                         uint64_t version)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (pending_)
+        {
+            // The worker has not picked up the previous job yet, so its
+            // edits have to be carried over.
+            pending_->edits.insert(pending_->edits.end(),
+                                   edits.begin(), edits.end());
+            pending_->snapshot = std::move(snapshot);
+            pending_->version = version;
+        }
+        else
+        {
+            pending_ = Job{ std::move(snapshot), std::move(edits), version };
+        }
+
+        cancel_flag_ = 1;
+    }
+    wake_.notify_one();
+}
+
+std::optional<ParseResult> ParseWorker::take_result()
+{
+    ParseResult* result = result_.exchange(nullptr, std::memory_order_acquire);
+    if (!result)
+        return std::nullopt;
+
+    std::optional<ParseResult> taken(std::move(*result));
+    delete result;
+
+    return taken;
+}
+
+void ParseWorker::run()
+{
+    while (true)
+    {
+        Job job;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stop_ || pending_; });
+
+            if (stop_)
+                return;
+
+            job = std::move(*pending_);
+            pending_.reset();
+
+            // Reset under the lock, so a cancellation requested by a newer
+            // submission cannot get lost.
+            cancel_flag_ = 0;
+        }
+
+        // The edits are applied even if the parse below gets cancelled,
+        // the next job only carries the edits made after this one.
+        if (tree_)
+        {
+            for (const zest::TextEdit& edit : job.edits)
+                edit_tree(tree_.get(), edit);
+        }
+
+        TreePtr tree(nullptr, delete_tree);
+        {
+            zest::profile::ScopedTimer timer(zest::profile::Stage::parse);
+            tree = parse_text(parser_.get(), job.snapshot, tree_.get());
+        }
+        if (!tree)
+            continue;
+
+        tree_ = std::move(tree);
+
+        ParseResult* result = new ParseResult{
+            TreePtr(ts_tree_copy(tree_.get()), delete_tree),
+            job.version
+        };
+        delete result_.exchange(result, std::memory_order_acq_rel);
+
+        if (on_result_)
+            on_result_();
+    }
+}
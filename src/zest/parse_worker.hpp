@@ -0,0 +1,83 @@
+#pragma once
+
+#include <zest/text.hpp>
+#include <zest/tree_sitter.hpp>
+#include <zest/types.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace zest
+{
+
+namespace tree_sitter
+{
+
+struct ParseResult
+{
+    TreePtr tree { nullptr, delete_tree };
+
+    // Number of edits, counted from the start, the tree already includes.
+    uint64_t version = 0;
+};
+
+// Parses snapshots of the buffer on a dedicated thread that owns the
+// parser. Finished trees are handed over to the render thread through an
+// atomic pointer, so neither side ever blocks on the other. Submitting new
+// text cancels a parse that is still running.
+class ParseWorker
+{
+public:
+    // on_result is called on the worker thread every time a result is
+    // ready, so that an event loop sleeping on something else can be woken.
+    explicit ParseWorker(ParserPtr parser,
+                         std::function<void()> on_result = {});
+    ~ParseWorker();
+
+    ParseWorker(const ParseWorker&) = delete;
+    ParseWorker& operator=(const ParseWorker&) = delete;
+
+    // The edits are the ones made since the previous submission, version
+    // is the total number of edits made so far.
+    void submit(TextSnapshot snapshot,
+                std::vector<zest::TextEdit> edits,
+                uint64_t version);
+
+    // The most recent finished parse that was not taken yet, if any.
+    std::optional<ParseResult> take_result();
+
+private:
+    struct Job
+    {
+        TextSnapshot snapshot;
+        std::vector<zest::TextEdit> edits;
+        uint64_t version;
+    };
+
+    void run();
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::optional<Job> pending_;
+    bool stop_ = false;
+
+    std::atomic<size_t> cancel_flag_ { 0 };
+    std::atomic<ParseResult*> result_ { nullptr };
+
+    // Only touched by the worker thread.
+    std::function<void()> on_result_;
+    ParserPtr parser_;
+    TreePtr tree_ { nullptr, delete_tree };
+
+    std::thread thread_;
+};
+
+} // namespace tree_sitter
+
+} // namespace zest
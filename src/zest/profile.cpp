@@ -0,0 +1,177 @@
+#include "profile.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+
+using namespace zest::profile;
+
+
+namespace
+{
+
+// Enough for the percentiles to settle, few enough to sort every frame.
+constexpr size_t sample_count = 256;
+
+// About 50 MB of events, a few minutes of frames at the default rate.
+constexpr size_t max_trace_events = size_t(1) << 21;
+
+struct Samples
+{
+    std::array<float, sample_count> ms;
+    size_t next = 0;
+    size_t size = 0;
+};
+
+struct TraceEvent
+{
+    Stage stage;
+    int thread;
+    int64_t start_ns;
+    int64_t duration_ns;
+};
+
+std::mutex mutex;
+std::array<Samples, stage_count> samples;
+
+bool tracing = false;
+std::vector<TraceEvent> trace_events;
+size_t dropped_events = 0;
+
+const Clock::time_point epoch = Clock::now();
+
+std::atomic<int> next_thread = 0;
+thread_local const int thread_index = next_thread++;
+
+} // namespace
+
+
+const char* zest::profile::stage_name(Stage stage)
+{
+    switch (stage)
+    {
+        case Stage::frame: return "frame";
+        case Stage::update: return "update";
+        case Stage::parse: return "parse";
+        case Stage::query: return "query";
+        case Stage::rasterize: return "rasterize";
+        case Stage::selection: return "selection";
+        case Stage::upload: return "upload";
+        case Stage::present: return "present";
+    }
+
+    return "unknown";
+}
+
+void zest::profile::enable()
+{
+    detail::enabled.store(true, std::memory_order_relaxed);
+}
+
+void zest::profile::enable_trace()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tracing = true;
+    }
+    enable();
+}
+
+void zest::profile::record(Stage stage,
+                           Clock::time_point start,
+                           Clock::time_point end)
+{
+    std::chrono::duration<float, std::milli> ms = end - start;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Samples& stage_samples = samples[int(stage)];
+    stage_samples.ms[stage_samples.next] = ms.count();
+    stage_samples.next = (stage_samples.next + 1) % sample_count;
+    stage_samples.size = std::min(stage_samples.size + 1, sample_count);
+
+    if (!tracing)
+        return;
+
+    if (trace_events.size() >= max_trace_events)
+    {
+        dropped_events++;
+        return;
+    }
+
+    trace_events.push_back({
+        stage,
+        thread_index,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            start - epoch).count(),
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            end - start).count()
+    });
+}
+
+StageStats zest::profile::stats(Stage stage)
+{
+    std::array<float, sample_count> ms;
+    size_t size;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ms = samples[int(stage)].ms;
+        size = samples[int(stage)].size;
+    }
+
+    if (size == 0)
+        return {};
+
+    auto percentile = [&] (size_t p)
+    {
+        size_t index = std::min(size*p/100, size - 1);
+        std::nth_element(ms.begin(), ms.begin() + index, ms.begin() + size);
+        return ms[index];
+    };
+
+    StageStats result;
+    result.p50_ms = percentile(50);
+    result.p99_ms = percentile(99);
+    result.samples = size;
+
+    return result;
+}
+
+bool zest::profile::write_trace(const std::string& path)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        std::cerr << "Failed to open trace file '" << path << "'\n";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Complete events, with the times in microseconds.
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for (size_t i = 0; i < trace_events.size(); ++i)
+    {
+        const TraceEvent& event = trace_events[i];
+        file << "{\"name\":\"" << stage_name(event.stage) << "\""
+             << ",\"cat\":\"zest\",\"ph\":\"X\",\"pid\":1"
+             << ",\"tid\":" << event.thread
+             << ",\"ts\":" << event.start_ns/1000 << "."
+             << (event.start_ns/100)%10
+             << ",\"dur\":" << event.duration_ns/1000 << "."
+             << (event.duration_ns/100)%10
+             << "}" << (i + 1 < trace_events.size() ? ",\n" : "\n");
+    }
+    file << "]}\n";
+
+    if (dropped_events > 0)
+        std::cerr << "The trace is missing the last " << dropped_events
+                  << " timings, it was full.\n";
+
+    return bool(file);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace zest
+{
+
+namespace profile
+{
+
+// The parts of a frame that are timed. Stages may nest, a selection is
+// drawn while rasterizing for instance.
+enum class Stage
+{
+    frame,
+    update,
+    parse,
+    query,
+    rasterize,
+    selection,
+    upload,
+    present,
+};
+
+constexpr int stage_count = int(Stage::present) + 1;
+
+const char* stage_name(Stage stage);
+
+using Clock = std::chrono::steady_clock;
+
+namespace detail
+{
+
+inline std::atomic<bool> enabled { false };
+
+} // namespace detail
+
+// Timers only read the clock once profiling was enabled, until then a
+// timer is a single relaxed load.
+inline bool is_enabled()
+{
+    return detail::enabled.load(std::memory_order_relaxed);
+}
+
+// Keeps the recent durations of every stage for stats.
+void enable();
+
+// Also keeps every single timing until write_trace, for a trace that
+// chrome://tracing or Perfetto can open.
+void enable_trace();
+
+// Thread safe, the parser reports from its worker thread.
+void record(Stage stage, Clock::time_point start, Clock::time_point end);
+
+struct StageStats
+{
+    double p50_ms = 0.0;
+    double p99_ms = 0.0;
+    size_t samples = 0;
+};
+
+// Percentiles over the last few hundred timings of the stage.
+StageStats stats(Stage stage);
+
+// Writes the trace events recorded so far in the Chrome trace event JSON
+// format. Returns false when the file could not be written.
+bool write_trace(const std::string& path);
+
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(Stage stage)
+        : stage_(stage),
+          active_(is_enabled())
+    {
+        if (active_)
+            start_ = Clock::now();
+    }
+
+    ~ScopedTimer()
+    {
+        if (active_)
+            record(stage_, start_, Clock::now());
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Stage stage_;
+    bool active_;
+    Clock::time_point start_;
+};
+
+} // namespace profile
+
+} // namespace zest
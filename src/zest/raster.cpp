@@ -0,0 +1,157 @@
+#include "raster.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ZEST_SSE2
+#include <emmintrin.h>
+#endif
+
+
+static uint32_t pack_color(const zest::Surface& surface, zest::Color color)
+{
+    uint8_t bytes[4] = { color.r, color.g, color.b, color.a };
+    if (surface.bgra)
+        std::swap(bytes[0], bytes[2]);
+
+    uint32_t pixel;
+    std::memcpy(&pixel, bytes, 4);
+    return pixel;
+}
+
+// Clips the rectangle to the surface and moves the mask along with it.
+// Returns false when nothing is left.
+static bool clip(const zest::Surface& surface,
+                 int& x, int& y, int& width, int& height,
+                 const uint8_t** mask = nullptr, size_t mask_stride = 0)
+{
+    int left = std::max(x, 0);
+    int top = std::max(y, 0);
+    int right = std::min(x + width, surface.width);
+    int bot = std::min(y + height, surface.height);
+
+    if (left >= right || top >= bot)
+        return false;
+
+    if (mask)
+        *mask += (top - y)*mask_stride + (left - x);
+
+    x = left;
+    y = top;
+    width = right - left;
+    height = bot - top;
+
+    return true;
+}
+
+// x/255 rounded, exact for x in [0, 255*255].
+static uint32_t div255(uint32_t x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+#ifdef ZEST_SSE2
+
+static __m128i div255(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// Blends two pixels held as 16-bit channels with the per-channel alphas.
+static __m128i blend(__m128i dst, __m128i src, __m128i alpha)
+{
+    __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+    return div255(_mm_add_epi16(_mm_mullo_epi16(src, alpha),
+                                _mm_mullo_epi16(dst, inverse)));
+}
+
+#endif
+
+void zest::fill_rect(Surface& surface, int x, int y, int width, int height,
+                     Color color)
+{
+    if (!clip(surface, x, y, width, height))
+        return;
+
+    uint32_t pixel = pack_color(surface, color);
+
+    uint8_t* row = surface.pixels + y*surface.stride + x*4;
+    for (int i = 0; i < width; ++i)
+        std::memcpy(row + i*4, &pixel, 4);
+
+    for (int j = 1; j < height; ++j)
+        std::memcpy(row + j*surface.stride, row, width*4);
+}
+
+void zest::blend_mask(Surface& surface, int x, int y,
+                      const uint8_t* mask, size_t mask_stride,
+                      int width, int height, Color color)
+{
+    if (!clip(surface, x, y, width, height, &mask, mask_stride))
+        return;
+
+    uint32_t opaque = pack_color(surface, { color.r, color.g, color.b, 255 });
+    uint8_t src[4];
+    std::memcpy(src, &opaque, 4);
+
+    for (int j = 0; j < height; ++j)
+    {
+        uint8_t* dst = surface.pixels + (y + j)*surface.stride + x*4;
+        const uint8_t* coverage = mask + j*mask_stride;
+
+        int i = 0;
+
+#ifdef ZEST_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i src_pixels = _mm_unpacklo_epi8(
+            _mm_set1_epi32(int(opaque)), zero);
+        const __m128i color_alpha = _mm_set1_epi16(color.a);
+
+        // Four pixels at a time, the coverage of each one is spread over
+        // its four channels.
+        for (; i + 4 <= width; i += 4)
+        {
+            uint32_t cover;
+            std::memcpy(&cover, coverage + i, 4);
+            if (cover == 0)
+                continue;
+
+            __m128i alpha = _mm_unpacklo_epi8(_mm_cvtsi32_si128(int(cover)),
+                                              zero);
+            alpha = div255(_mm_mullo_epi16(alpha, color_alpha));
+            alpha = _mm_unpacklo_epi16(alpha, alpha);
+            __m128i alpha_lo = _mm_unpacklo_epi32(alpha, alpha);
+            __m128i alpha_hi = _mm_unpackhi_epi32(alpha, alpha);
+
+            __m128i pixels = _mm_loadu_si128((const __m128i*)(dst + i*4));
+            __m128i lo = blend(_mm_unpacklo_epi8(pixels, zero),
+                               src_pixels, alpha_lo);
+            __m128i hi = blend(_mm_unpackhi_epi8(pixels, zero),
+                               src_pixels, alpha_hi);
+
+            _mm_storeu_si128((__m128i*)(dst + i*4), _mm_packus_epi16(lo, hi));
+        }
+#endif
+
+        for (; i < width; ++i)
+        {
+            uint32_t alpha = div255(coverage[i]*color.a);
+            if (alpha == 0)
+                continue;
+
+            uint8_t* pixel = dst + i*4;
+            if (alpha == 255)
+            {
+                std::memcpy(pixel, &opaque, 4);
+                continue;
+            }
+
+            for (int c = 0; c < 4; ++c)
+                pixel[c] = div255(src[c]*alpha + pixel[c]*(255 - alpha));
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <zest/types.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace zest
+{
+
+// View of 32-bit pixels in memory, 4 bytes per pixel with alpha last.
+// Nothing here depends on the window library, so the same drawing code
+// works for a raylib image and for a shared memory X11 image.
+struct Surface
+{
+    uint8_t* pixels;
+    int width;
+    int height;
+
+    // Bytes between the starts of two rows.
+    size_t stride;
+
+    // The pixels are stored as B, G, R, A instead of R, G, B, A.
+    bool bgra = false;
+};
+
+// Rectangles are clipped to the surface, they may lie partially or
+// entirely outside of it.
+void fill_rect(Surface& surface, int x, int y, int width, int height,
+               Color color);
+
+// Blends the color into the surface with the coverage of every pixel
+// taken from an 8-bit mask, as glyphs are drawn.
+void blend_mask(Surface& surface, int x, int y,
+                const uint8_t* mask, size_t mask_stride,
+                int width, int height, Color color);
+
+} // namespace zest
@@ -12,6 +12,11 @@ inline Vec2 zestify(Vector2 vec)
     return { vec.x, vec.y };
 }
 
+inline Color zestify(::Color color)
+{
+    return { color.r, color.g, color.b, color.a };
+}
+
 namespace raylib
 {
 
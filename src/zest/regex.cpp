@@ -0,0 +1,1193 @@
+#include "regex.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+
+namespace
+{
+
+// Repetition counts above this are rejected, {m,n} copies its operand.
+constexpr int max_repeat = 1000;
+
+// Patterns that compile to more instructions than this are rejected.
+constexpr size_t max_program_size = 100000;
+
+// A DFA that built this many states starts over from scratch, which keeps
+// the memory bounded for patterns whose DFA would be huge.
+constexpr size_t max_dfa_states = 2048;
+
+// How many compiled patterns compile_cached keeps around.
+constexpr size_t regex_cache_size = 16;
+
+constexpr uint32_t max_codepoint = 0x10ffff;
+
+using CodepointRanges = std::vector<std::pair<uint32_t, uint32_t>>;
+
+struct Node
+{
+    enum class Kind
+    {
+        empty,
+        // Never matches, an empty character class.
+        nothing,
+        // A single byte in [lo, hi].
+        range,
+        concat,
+        alternate,
+        // The child between min and max times, max < 0 is unbounded.
+        repeat,
+        line_start,
+        line_end,
+    };
+
+    Kind kind = Kind::empty;
+    uint8_t lo = 0;
+    uint8_t hi = 0;
+    int min = 0;
+    int max = 0;
+    std::vector<Node> children;
+};
+
+Node range_node(uint8_t lo, uint8_t hi)
+{
+    Node node;
+    node.kind = Node::Kind::range;
+    node.lo = lo;
+    node.hi = hi;
+    return node;
+}
+
+int encode_utf8(uint32_t codepoint, uint8_t* bytes)
+{
+    if (codepoint < 0x80)
+    {
+        bytes[0] = codepoint;
+        return 1;
+    }
+
+    if (codepoint < 0x800)
+    {
+        bytes[0] = 0xc0 | (codepoint >> 6);
+        bytes[1] = 0x80 | (codepoint & 0x3f);
+        return 2;
+    }
+
+    if (codepoint < 0x10000)
+    {
+        bytes[0] = 0xe0 | (codepoint >> 12);
+        bytes[1] = 0x80 | ((codepoint >> 6) & 0x3f);
+        bytes[2] = 0x80 | (codepoint & 0x3f);
+        return 3;
+    }
+
+    bytes[0] = 0xf0 | (codepoint >> 18);
+    bytes[1] = 0x80 | ((codepoint >> 12) & 0x3f);
+    bytes[2] = 0x80 | ((codepoint >> 6) & 0x3f);
+    bytes[3] = 0x80 | (codepoint & 0x3f);
+    return 4;
+}
+
+// Splits the codepoints [lo, hi] into sequences of byte ranges, one per
+// alternative. Every sequence has a single encoded length and, within it,
+// every byte can vary over a whole range independently of the others.
+void append_utf8_ranges(uint32_t lo, uint32_t hi, std::vector<Node>& result)
+{
+    for (uint32_t max : { 0x7fu, 0x7ffu, 0xffffu })
+    {
+        if (lo <= max && hi > max)
+        {
+            append_utf8_ranges(lo, max, result);
+            append_utf8_ranges(max + 1, hi, result);
+            return;
+        }
+    }
+
+    if (hi < 0x80)
+    {
+        result.push_back(range_node(lo, hi));
+        return;
+    }
+
+    for (int i = 1; i < 4; ++i)
+    {
+        uint32_t mask = (1u << (6*i)) - 1;
+        if ((lo & ~mask) == (hi & ~mask))
+            continue;
+
+        if ((lo & mask) != 0)
+        {
+            append_utf8_ranges(lo, lo | mask, result);
+            append_utf8_ranges((lo | mask) + 1, hi, result);
+            return;
+        }
+
+        if ((hi & mask) != mask)
+        {
+            append_utf8_ranges(lo, (hi & ~mask) - 1, result);
+            append_utf8_ranges(hi & ~mask, hi, result);
+            return;
+        }
+    }
+
+    uint8_t lo_bytes[4];
+    uint8_t hi_bytes[4];
+    int length = encode_utf8(lo, lo_bytes);
+    encode_utf8(hi, hi_bytes);
+
+    Node sequence;
+    sequence.kind = Node::Kind::concat;
+    for (int i = 0; i < length; ++i)
+        sequence.children.push_back(range_node(lo_bytes[i], hi_bytes[i]));
+    result.push_back(std::move(sequence));
+}
+
+// Sorts the ranges and merges the ones that overlap or touch.
+void normalize(CodepointRanges& ranges)
+{
+    std::sort(ranges.begin(), ranges.end());
+
+    CodepointRanges merged;
+    for (auto [lo, hi] : ranges)
+    {
+        if (!merged.empty() && lo <= merged.back().second + 1)
+            merged.back().second = std::max(merged.back().second, hi);
+        else
+            merged.push_back({ lo, hi });
+    }
+
+    ranges = std::move(merged);
+}
+
+// Everything but the ranges and '\n', which never is inside a line. The
+// ranges have to be normalized.
+CodepointRanges negate(const CodepointRanges& ranges)
+{
+    CodepointRanges result;
+
+    uint32_t next = 0;
+    for (auto [lo, hi] : ranges)
+    {
+        if (lo > next)
+            result.push_back({ next, lo - 1 });
+        next = hi + 1;
+    }
+    if (next <= max_codepoint)
+        result.push_back({ next, max_codepoint });
+
+    CodepointRanges without_newline;
+    for (auto [lo, hi] : result)
+    {
+        if (lo <= '\n' && hi >= '\n')
+        {
+            if (lo < '\n')
+                without_newline.push_back({ lo, '\n' - 1 });
+            if (hi > '\n')
+                without_newline.push_back({ '\n' + 1, hi });
+        }
+        else
+        {
+            without_newline.push_back({ lo, hi });
+        }
+    }
+
+    return without_newline;
+}
+
+Node class_node(CodepointRanges ranges)
+{
+    normalize(ranges);
+
+    Node node;
+    node.kind = Node::Kind::alternate;
+    for (auto [lo, hi] : ranges)
+        append_utf8_ranges(lo, hi, node.children);
+
+    if (node.children.empty())
+        node.kind = Node::Kind::nothing;
+    else if (node.children.size() == 1)
+        return std::move(node.children[0]);
+
+    return node;
+}
+
+class Parser
+{
+public:
+    explicit Parser(std::string_view pattern)
+        : pattern_(pattern)
+    {}
+
+    Node parse()
+    {
+        Node node = parse_alternate();
+        if (pos_ < pattern_.size())
+            error("unmatched ')'");
+
+        return node;
+    }
+
+private:
+    std::string_view pattern_;
+    size_t pos_ = 0;
+
+    [[noreturn]] void error(const std::string& message) const
+    {
+        throw std::runtime_error("Invalid regex at " + std::to_string(pos_)
+                                 + ": " + message);
+    }
+
+    bool at_end() const { return pos_ >= pattern_.size(); }
+    char peek() const { return pattern_[pos_]; }
+
+    bool accept(char c)
+    {
+        if (at_end() || peek() != c)
+            return false;
+
+        pos_++;
+        return true;
+    }
+
+    Node parse_alternate()
+    {
+        Node node;
+        node.kind = Node::Kind::alternate;
+        node.children.push_back(parse_concat());
+
+        while (accept('|'))
+            node.children.push_back(parse_concat());
+
+        if (node.children.size() == 1)
+            return std::move(node.children[0]);
+
+        return node;
+    }
+
+    Node parse_concat()
+    {
+        Node node;
+        node.kind = Node::Kind::concat;
+
+        while (!at_end() && peek() != '|' && peek() != ')')
+            node.children.push_back(parse_repeat());
+
+        if (node.children.empty())
+            return Node();
+        if (node.children.size() == 1)
+            return std::move(node.children[0]);
+
+        return node;
+    }
+
+    int parse_count()
+    {
+        if (at_end() || peek() < '0' || peek() > '9')
+            error("expected a number");
+
+        int count = 0;
+        while (!at_end() && peek() >= '0' && peek() <= '9')
+        {
+            count = count*10 + (peek() - '0');
+            if (count > max_repeat)
+                error("repetition count above "
+                      + std::to_string(max_repeat));
+            pos_++;
+        }
+
+        return count;
+    }
+
+    Node parse_repeat()
+    {
+        Node node = parse_atom();
+
+        while (!at_end())
+        {
+            int min, max;
+            if (accept('*'))
+            {
+                min = 0;
+                max = -1;
+            }
+            else if (accept('+'))
+            {
+                min = 1;
+                max = -1;
+            }
+            else if (accept('?'))
+            {
+                min = 0;
+                max = 1;
+            }
+            else if (accept('{'))
+            {
+                min = parse_count();
+                max = min;
+                if (accept(','))
+                    max = !at_end() && peek() == '}' ? -1 : parse_count();
+                if (!accept('}'))
+                    error("expected '}'");
+                if (max >= 0 && max < min)
+                    error("repetition range out of order");
+            }
+            else
+            {
+                break;
+            }
+
+            // Lazy quantifiers make no difference to the longest match.
+            accept('?');
+
+            Node repeat;
+            repeat.kind = Node::Kind::repeat;
+            repeat.min = min;
+            repeat.max = max;
+            repeat.children.push_back(std::move(node));
+            node = std::move(repeat);
+        }
+
+        return node;
+    }
+
+    // Decodes the codepoint at the current position.
+    uint32_t parse_codepoint()
+    {
+        uint8_t lead = peek();
+        int length = lead < 0x80 ? 1
+                     : (lead >> 5) == 0x6 ? 2
+                     : (lead >> 4) == 0xe ? 3
+                     : (lead >> 3) == 0x1e ? 4
+                     : 0;
+        if (length == 0 || pos_ + length > pattern_.size())
+            error("invalid UTF-8");
+
+        uint32_t codepoint = length == 1 ? lead
+                             : lead & (0x7f >> length);
+        for (int i = 1; i < length; ++i)
+        {
+            uint8_t byte = pattern_[pos_ + i];
+            if ((byte & 0xc0) != 0x80)
+                error("invalid UTF-8");
+            codepoint = (codepoint << 6) | (byte & 0x3f);
+        }
+
+        pos_ += length;
+        return codepoint;
+    }
+
+    int parse_hex_digit()
+    {
+        if (at_end())
+            error("expected a hex digit");
+
+        char c = pattern_[pos_++];
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+
+        error("expected a hex digit");
+    }
+
+    // The class of \d, \w, \s and their negations, empty for other
+    // escapes.
+    static CodepointRanges escape_class(char c)
+    {
+        CodepointRanges ranges;
+        switch (c)
+        {
+        case 'd': case 'D':
+            ranges = { { '0', '9' } };
+            break;
+        case 'w': case 'W':
+            ranges = { { '0', '9' }, { 'A', 'Z' }, { '_', '_' },
+                       { 'a', 'z' } };
+            break;
+        case 's': case 'S':
+            ranges = { { '\t', '\r' }, { ' ', ' ' } };
+            break;
+        default:
+            return {};
+        }
+
+        if (c >= 'A' && c <= 'Z')
+            ranges = negate(ranges);
+
+        return ranges;
+    }
+
+    // After the backslash, for escapes that stand for a single codepoint.
+    uint32_t parse_escaped_codepoint()
+    {
+        if (at_end())
+            error("trailing backslash");
+
+        char c = pattern_[pos_++];
+        switch (c)
+        {
+        case 't': return '\t';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 'f': return '\f';
+        case 'v': return '\v';
+        case 'x':
+        {
+            int high = parse_hex_digit();
+            return high*16 + parse_hex_digit();
+        }
+        }
+
+        if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z')
+            || (c >= 'A' && c <= 'Z') || uint8_t(c) >= 0x80)
+        {
+            pos_--;
+            error(std::string("unknown escape '\\") + c + "'");
+        }
+
+        return uint8_t(c);
+    }
+
+    Node parse_class()
+    {
+        bool negated = accept('^');
+
+        CodepointRanges ranges;
+        bool first = true;
+        while (!at_end() && (peek() != ']' || first))
+        {
+            first = false;
+
+            uint32_t lo;
+            if (accept('\\'))
+            {
+                CodepointRanges escaped = escape_class(peek());
+                if (!escaped.empty())
+                {
+                    pos_++;
+                    ranges.insert(ranges.end(),
+                                  escaped.begin(), escaped.end());
+                    continue;
+                }
+                lo = parse_escaped_codepoint();
+            }
+            else
+            {
+                lo = parse_codepoint();
+            }
+
+            uint32_t hi = lo;
+            if (pos_ + 1 < pattern_.size() && peek() == '-'
+                && pattern_[pos_ + 1] != ']')
+            {
+                pos_++;
+                hi = accept('\\') ? parse_escaped_codepoint()
+                                  : parse_codepoint();
+                if (hi < lo)
+                    error("class range out of order");
+            }
+
+            ranges.push_back({ lo, hi });
+        }
+
+        if (!accept(']'))
+            error("missing ']'");
+
+        if (negated)
+        {
+            normalize(ranges);
+            ranges = negate(ranges);
+        }
+
+        return class_node(std::move(ranges));
+    }
+
+    Node literal_node(uint32_t codepoint)
+    {
+        uint8_t bytes[4];
+        int length = encode_utf8(codepoint, bytes);
+        if (length == 1)
+            return range_node(bytes[0], bytes[0]);
+
+        Node node;
+        node.kind = Node::Kind::concat;
+        for (int i = 0; i < length; ++i)
+            node.children.push_back(range_node(bytes[i], bytes[i]));
+        return node;
+    }
+
+    Node parse_atom()
+    {
+        char c = peek();
+        switch (c)
+        {
+        case '(':
+        {
+            pos_++;
+            if (pattern_.substr(pos_, 2) == "?:")
+                pos_ += 2;
+
+            Node node = parse_alternate();
+            if (!accept(')'))
+                error("missing ')'");
+            return node;
+        }
+        case '[':
+            pos_++;
+            return parse_class();
+        case '.':
+            pos_++;
+            return class_node(negate({}));
+        case '^':
+        {
+            pos_++;
+            Node node;
+            node.kind = Node::Kind::line_start;
+            return node;
+        }
+        case '$':
+        {
+            pos_++;
+            Node node;
+            node.kind = Node::Kind::line_end;
+            return node;
+        }
+        case '*': case '+': case '?': case '{':
+            error("nothing to repeat");
+        case '\\':
+        {
+            pos_++;
+            if (!at_end())
+            {
+                CodepointRanges escaped = escape_class(peek());
+                if (!escaped.empty())
+                {
+                    pos_++;
+                    return class_node(std::move(escaped));
+                }
+            }
+            return literal_node(parse_escaped_codepoint());
+        }
+        }
+
+        return literal_node(parse_codepoint());
+    }
+};
+
+} // namespace
+
+
+namespace zest
+{
+namespace regex
+{
+
+struct Inst
+{
+    enum class Op : uint8_t
+    {
+        // Consumes a byte in [lo, hi].
+        range,
+        // Continues at both out and out1.
+        split,
+        match,
+        line_start,
+        line_end,
+    };
+
+    Op op;
+    uint8_t lo = 0;
+    uint8_t hi = 0;
+    uint32_t out = 0;
+    uint32_t out1 = 0;
+};
+
+// Thompson NFA of a pattern. The reverse program matches the reversed
+// text, it is used to find where a match starts once its end is known.
+struct Program
+{
+    std::vector<Inst> insts;
+    uint32_t start;
+
+    Program(const Node& node, bool reverse)
+    {
+        Inst match;
+        match.op = Inst::Op::match;
+        insts.push_back(match);
+
+        start = compile(node, 0, reverse);
+    }
+
+private:
+    uint32_t push(Inst inst)
+    {
+        if (insts.size() >= max_program_size)
+            throw std::runtime_error("Invalid regex: pattern is too large");
+
+        insts.push_back(inst);
+        return insts.size() - 1;
+    }
+
+    uint32_t split(uint32_t out, uint32_t out1)
+    {
+        Inst inst;
+        inst.op = Inst::Op::split;
+        inst.out = out;
+        inst.out1 = out1;
+        return push(inst);
+    }
+
+    // Compiles the node so that it continues at next once it matched and
+    // returns the instruction it starts with.
+    uint32_t compile(const Node& node, uint32_t next, bool reverse)
+    {
+        using Kind = Node::Kind;
+
+        switch (node.kind)
+        {
+        case Kind::empty:
+            return next;
+
+        case Kind::nothing:
+        {
+            Inst inst;
+            inst.op = Inst::Op::range;
+            inst.lo = 1;
+            inst.hi = 0;
+            inst.out = next;
+            return push(inst);
+        }
+
+        case Kind::range:
+        {
+            Inst inst;
+            inst.op = Inst::Op::range;
+            inst.lo = node.lo;
+            inst.hi = node.hi;
+            inst.out = next;
+            return push(inst);
+        }
+
+        case Kind::concat:
+            if (reverse)
+            {
+                for (const Node& child : node.children)
+                    next = compile(child, next, reverse);
+            }
+            else
+            {
+                for (auto it = node.children.rbegin();
+                     it != node.children.rend();
+                     ++it)
+                {
+                    next = compile(*it, next, reverse);
+                }
+            }
+            return next;
+
+        case Kind::alternate:
+        {
+            uint32_t entry = compile(node.children.back(), next, reverse);
+            for (size_t i = node.children.size() - 1; i-- > 0; )
+                entry = split(compile(node.children[i], next, reverse),
+                              entry);
+            return entry;
+        }
+
+        case Kind::repeat:
+        {
+            const Node& child = node.children[0];
+
+            uint32_t entry = next;
+            if (node.max < 0)
+            {
+                uint32_t loop = split(0, next);
+                uint32_t body = compile(child, loop, reverse);
+                insts[loop].out = body;
+                entry = loop;
+            }
+            else
+            {
+                for (int i = node.min; i < node.max; ++i)
+                    entry = split(compile(child, entry, reverse), entry);
+            }
+
+            for (int i = 0; i < node.min; ++i)
+                entry = compile(child, entry, reverse);
+
+            return entry;
+        }
+
+        case Kind::line_start:
+        case Kind::line_end:
+        {
+            // Reversed, the start of the line is where matching ends.
+            Inst inst;
+            inst.op = (node.kind == Kind::line_start) != reverse
+                          ? Inst::Op::line_start
+                          : Inst::Op::line_end;
+            inst.out = next;
+            return push(inst);
+        }
+        }
+
+        return next;
+    }
+};
+
+// A DFA over a program, built one state at a time as the text reaches
+// them. A state is the set of NFA instructions that are alive at a
+// position.
+//
+// An unanchored DFA starts a new attempt at every position. Its states
+// keep the attempts in the order they started, as separate sets, and
+// once one of them matched, the later ones are dropped and no new ones
+// are started: none of them could be the leftmost match. Running it until
+// it dies therefore ends at the end of the leftmost longest match.
+class Dfa
+{
+public:
+    static constexpr int32_t dead = 0;
+
+    Dfa(const Program& program, bool unanchored)
+        : program_(program),
+          unanchored_(unanchored),
+          visited_(program.insts.size(), 0)
+    {
+        clear();
+    }
+
+    int32_t start(bool at_line_start)
+    {
+        int32_t& state = start_[at_line_start];
+        if (state < 0)
+        {
+            std::vector<int32_t> threads;
+            next_generation();
+            add_closure(program_.start, at_line_start, false, threads);
+            std::sort(threads.begin(), threads.end());
+
+            bool match = contains_match(threads, 0);
+            if (!threads.empty())
+                threads.push_back(separator);
+
+            state = add_state(std::move(threads), match, match);
+        }
+
+        return state;
+    }
+
+    int32_t next(int32_t state, uint8_t byte)
+    {
+        int32_t target = transitions_[size_t(state)*256 + byte];
+        if (target >= 0)
+            return target;
+
+        return build_next(state, byte);
+    }
+
+    bool is_match(int32_t state) const { return matches_[state]; }
+
+    // Whether the state matches when the line ends here.
+    bool is_match_at_end(int32_t state)
+    {
+        State& s = states_[state];
+        if (s.match_at_end < 0)
+        {
+            s.match_at_end = s.match;
+
+            std::vector<int32_t> threads;
+            next_generation();
+            for (int32_t pc : s.threads)
+            {
+                if (pc != separator
+                    && program_.insts[pc].op == Inst::Op::line_end)
+                {
+                    add_closure(program_.insts[pc].out, false, true,
+                                threads);
+                }
+            }
+
+            if (contains_match(threads, 0))
+                s.match_at_end = true;
+        }
+
+        return s.match_at_end;
+    }
+
+private:
+    static constexpr int32_t separator = -1;
+
+    struct State
+    {
+        // Instructions of each attempt, every set ends with a separator.
+        std::vector<int32_t> threads;
+
+        // An attempt matched at this position or before it.
+        bool matched = false;
+
+        // An attempt matches at this position.
+        bool match = false;
+
+        int8_t match_at_end = -1;
+    };
+
+    const Program& program_;
+    bool unanchored_;
+
+    std::vector<State> states_;
+    std::vector<int32_t> transitions_;
+
+    // State::match of every state, apart so the search loop stays in
+    // cache.
+    std::vector<uint8_t> matches_;
+    std::unordered_map<std::string, int32_t> index_;
+    int32_t start_[2];
+    uint64_t clears_ = 0;
+
+    std::vector<uint32_t> visited_;
+    uint32_t generation_ = 0;
+    std::vector<uint32_t> stack_;
+
+    void clear()
+    {
+        states_.clear();
+        transitions_.clear();
+        matches_.clear();
+        index_.clear();
+        start_[0] = start_[1] = -1;
+        clears_++;
+
+        // The dead state has no threads and never leaves itself.
+        states_.emplace_back();
+        transitions_.assign(256, dead);
+        matches_.push_back(false);
+        index_.emplace(std::string(1, '\0'), dead);
+    }
+
+    void next_generation()
+    {
+        if (++generation_ == 0)
+        {
+            std::fill(visited_.begin(), visited_.end(), 0);
+            generation_ = 1;
+        }
+    }
+
+    // Adds the instructions reachable from pc without consuming a byte.
+    // Instructions already added in this generation are skipped, so an
+    // instruction only ever belongs to the earliest attempt.
+    void add_closure(uint32_t pc, bool at_line_start, bool at_line_end,
+                     std::vector<int32_t>& threads)
+    {
+        stack_.push_back(pc);
+        while (!stack_.empty())
+        {
+            pc = stack_.back();
+            stack_.pop_back();
+
+            if (visited_[pc] == generation_)
+                continue;
+            visited_[pc] = generation_;
+
+            const Inst& inst = program_.insts[pc];
+            switch (inst.op)
+            {
+            case Inst::Op::range:
+            case Inst::Op::match:
+                threads.push_back(pc);
+                break;
+            case Inst::Op::split:
+                stack_.push_back(inst.out1);
+                stack_.push_back(inst.out);
+                break;
+            case Inst::Op::line_start:
+                if (at_line_start)
+                    stack_.push_back(inst.out);
+                break;
+            case Inst::Op::line_end:
+                // Kept, it may still hold when the line ends here.
+                if (at_line_end)
+                    stack_.push_back(inst.out);
+                else
+                    threads.push_back(pc);
+                break;
+            }
+        }
+    }
+
+    bool contains_match(const std::vector<int32_t>& threads,
+                        size_t from) const
+    {
+        for (size_t i = from; i < threads.size(); ++i)
+        {
+            if (threads[i] != separator
+                && program_.insts[threads[i]].op == Inst::Op::match)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    int32_t build_next(int32_t state, uint8_t byte)
+    {
+        const State& source = states_[state];
+
+        std::vector<int32_t> threads;
+        bool matched = source.matched;
+        bool match = false;
+
+        next_generation();
+
+        size_t set_start = 0;
+        for (int32_t pc : source.threads)
+        {
+            if (pc != separator)
+            {
+                const Inst& inst = program_.insts[pc];
+                if (inst.op == Inst::Op::range
+                    && byte >= inst.lo && byte <= inst.hi)
+                {
+                    add_closure(inst.out, false, false, threads);
+                }
+                continue;
+            }
+
+            if (threads.size() == set_start)
+                continue;
+
+            std::sort(threads.begin() + set_start, threads.end());
+            bool set_matches = contains_match(threads, set_start);
+            threads.push_back(separator);
+            set_start = threads.size();
+
+            if (set_matches)
+            {
+                matched = true;
+                match = true;
+                break;
+            }
+        }
+
+        if (unanchored_ && !matched)
+        {
+            add_closure(program_.start, false, false, threads);
+            if (threads.size() > set_start)
+            {
+                std::sort(threads.begin() + set_start, threads.end());
+                if (contains_match(threads, set_start))
+                {
+                    matched = true;
+                    match = true;
+                }
+                threads.push_back(separator);
+            }
+        }
+
+        uint64_t clears = clears_;
+        int32_t target = add_state(std::move(threads), matched, match);
+
+        // When adding the state cleared the cache, the source is gone.
+        if (clears == clears_)
+            transitions_[size_t(state)*256 + byte] = target;
+
+        return target;
+    }
+
+    int32_t add_state(std::vector<int32_t> threads, bool matched,
+                      bool match)
+    {
+        if (threads.empty())
+            return dead;
+
+        std::string key(1, matched ? '\1' : '\2');
+        key.append(reinterpret_cast<const char*>(threads.data()),
+                   threads.size()*sizeof(int32_t));
+
+        auto it = index_.find(key);
+        if (it != index_.end())
+            return it->second;
+
+        if (states_.size() >= max_dfa_states)
+            clear();
+
+        int32_t id = states_.size();
+
+        State state;
+        state.threads = std::move(threads);
+        state.matched = matched;
+        state.match = match;
+        states_.push_back(std::move(state));
+        transitions_.resize(states_.size()*256, -1);
+        matches_.push_back(match);
+        index_.emplace(std::move(key), id);
+
+        return id;
+    }
+};
+
+struct DfaPair
+{
+    Dfa forward;
+    Dfa reverse;
+};
+
+Regex::Regex(std::string_view pattern)
+    : pattern_(pattern)
+{
+    Node node = Parser(pattern).parse();
+
+    forward_ = std::make_unique<const Program>(node, false);
+    reverse_ = std::make_unique<const Program>(node, true);
+}
+
+Regex::~Regex() = default;
+
+Matcher::Matcher(std::shared_ptr<const Regex> regex)
+    : regex_(std::move(regex))
+{
+    {
+        std::lock_guard<std::mutex> lock(regex_->mutex_);
+        if (!regex_->idle_dfas_.empty())
+        {
+            dfas_ = std::move(regex_->idle_dfas_.back());
+            regex_->idle_dfas_.pop_back();
+        }
+    }
+
+    if (!dfas_)
+        dfas_.reset(new DfaPair { Dfa(*regex_->forward_, true),
+                                  Dfa(*regex_->reverse_, false) });
+}
+
+Matcher::~Matcher()
+{
+    std::lock_guard<std::mutex> lock(regex_->mutex_);
+    regex_->idle_dfas_.push_back(std::move(dfas_));
+}
+
+bool Matcher::find_in_line(std::string_view line, size_t base,
+                           std::vector<ByteRange>& matches,
+                           const std::atomic<bool>& cancelled)
+{
+    // Bytes between two looks at the cancellation flag.
+    constexpr size_t cancel_check_interval = 64*1024;
+
+    Dfa& forward = dfas_->forward;
+    Dfa& reverse = dfas_->reverse;
+
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(line.data());
+    size_t size = line.size();
+
+    size_t pos = 0;
+    while (pos < size)
+    {
+        if (cancelled.load(std::memory_order_relaxed))
+            return false;
+
+        // The end of the leftmost longest match starting at pos or later.
+        int32_t state = forward.start(pos == 0);
+        ptrdiff_t end = forward.is_match(state) ? ptrdiff_t(pos) : -1;
+
+        size_t i = pos;
+        while (i < size)
+        {
+            size_t chunk_end = std::min(size, i + cancel_check_interval);
+            for (; i < chunk_end; ++i)
+            {
+                state = forward.next(state, data[i]);
+                if (state == Dfa::dead)
+                    break;
+                if (forward.is_match(state))
+                    end = i + 1;
+            }
+
+            if (state == Dfa::dead)
+                break;
+            if (i < size && cancelled.load(std::memory_order_relaxed))
+                return false;
+        }
+
+        if (i == size && state != Dfa::dead
+            && forward.is_match_at_end(state))
+        {
+            end = size;
+        }
+
+        if (end < 0)
+            return true;
+
+        // Back from the end to find where that match starts, the longest
+        // reverse match is the leftmost start.
+        state = reverse.start(size_t(end) == size);
+        ptrdiff_t start = reverse.is_match(state) ? end : -1;
+
+        size_t j = end;
+        for (; j > pos; --j)
+        {
+            state = reverse.next(state, data[j - 1]);
+            if (state == Dfa::dead)
+                break;
+            if (reverse.is_match(state))
+                start = j - 1;
+        }
+
+        if (j == 0 && state != Dfa::dead && reverse.is_match_at_end(state))
+            start = 0;
+
+        // Cannot happen unless the programs disagree.
+        if (start < 0)
+            return true;
+
+        if (end > start)
+            matches.push_back({ base + start, base + end });
+
+        pos = std::max<size_t>(end, start + 1);
+    }
+
+    return true;
+}
+
+std::shared_ptr<const Regex> compile_cached(const std::string& pattern)
+{
+    static std::mutex mutex;
+    static std::list<std::shared_ptr<const Regex>> regexes;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = std::find_if(regexes.begin(), regexes.end(),
+                               [&] (const auto& regex)
+                               {
+                                   return regex->pattern() == pattern;
+                               });
+        if (it != regexes.end())
+        {
+            regexes.splice(regexes.begin(), regexes, it);
+            return regexes.front();
+        }
+    }
+
+    // Compiled outside the lock, throws for malformed patterns which are
+    // then not cached.
+    auto regex = std::make_shared<const Regex>(pattern);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    regexes.push_front(regex);
+    if (regexes.size() > regex_cache_size)
+        regexes.pop_back();
+
+    return regex;
+}
+
+} // namespace regex
+} // namespace zest
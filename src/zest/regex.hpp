@@ -0,0 +1,86 @@
+#pragma once
+
+#include <zest/types.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace zest
+{
+namespace regex
+{
+
+struct Program;
+struct DfaPair;
+
+// A regular expression compiled to an NFA, matched by DFAs whose states
+// are only built when the text first leads to them, so matching never
+// backtracks and takes time linear in the text.
+//
+// The syntax is a subset of the usual one: literals, '.', character
+// classes with ranges and negation, the escapes \d \w \s \D \W \S \t \n
+// \r \xHH and escaped punctuation, groups, alternation, the quantifiers
+// * + ? {m} {m,} {m,n} and the anchors ^ and $, which match at the start
+// and the end of a line. Text is UTF-8, '.' and classes match whole
+// codepoints. Matches are leftmost longest.
+class Regex
+{
+public:
+    // Throws std::runtime_error when the pattern is malformed or too
+    // large.
+    explicit Regex(std::string_view pattern);
+    ~Regex();
+
+    Regex(const Regex&) = delete;
+    Regex& operator=(const Regex&) = delete;
+
+    const std::string& pattern() const { return pattern_; }
+
+private:
+    friend class Matcher;
+
+    std::string pattern_;
+
+    std::unique_ptr<const Program> forward_;
+    std::unique_ptr<const Program> reverse_;
+
+    // DFAs of earlier matchers, with the states they built so far.
+    mutable std::mutex mutex_;
+    mutable std::vector<std::unique_ptr<DfaPair>> idle_dfas_;
+};
+
+// Finds the matches of a regex, one line at a time. A matcher belongs to
+// a single thread, any number of them can share a regex.
+class Matcher
+{
+public:
+    explicit Matcher(std::shared_ptr<const Regex> regex);
+    ~Matcher();
+
+    Matcher(const Matcher&) = delete;
+    Matcher& operator=(const Matcher&) = delete;
+
+    // Appends the non-empty matches in the line, which must not contain
+    // '\n', offset by base. Returns false when cancelled was set before
+    // the whole line was searched, which is checked every 64 KB.
+    bool find_in_line(std::string_view line, size_t base,
+                      std::vector<ByteRange>& matches,
+                      const std::atomic<bool>& cancelled);
+
+private:
+    std::shared_ptr<const Regex> regex_;
+    std::unique_ptr<DfaPair> dfas_;
+};
+
+// Same as constructing a Regex, but the last few patterns are kept
+// compiled along with their DFAs, so searching for one of them again
+// starts with the states earlier searches built.
+std::shared_ptr<const Regex> compile_cached(const std::string& pattern);
+
+} // namespace regex
+} // namespace zest
@@ -0,0 +1,393 @@
+#include "save_file.hpp"
+
+#include <zest/mapped_file.hpp>
+#include <zest/text.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+
+namespace
+{
+
+// Unchanged ranges of a mapped original shorter than this are written
+// along with the pieces around them, longer ones are copied file to file.
+constexpr size_t min_copy_length = 64*1024;
+
+// Temporary names tried before giving up, in case earlier ones are taken.
+constexpr int max_temp_attempts = 100;
+
+std::string temp_path(const std::string& path, int attempt)
+{
+#ifdef _WIN32
+    unsigned long pid = GetCurrentProcessId();
+#else
+    unsigned long pid = getpid();
+#endif
+
+    return path + ".zest-" + std::to_string(pid) + "-"
+           + std::to_string(attempt);
+}
+
+// Where the bytes are in the mapped file, SIZE_MAX when they are not
+// part of its mapping.
+size_t offset_in(const zest::MappedFile& file, const char* data)
+{
+    uintptr_t offset = uintptr_t(data) - uintptr_t(file.data());
+    return offset < file.size() ? offset : SIZE_MAX;
+}
+
+#ifdef _WIN32
+
+// Small pieces are gathered in here and written together.
+constexpr size_t batch_size = 1024*1024;
+
+[[noreturn]] void fail(const std::string& path)
+{
+    throw std::runtime_error("Cannot save file '" + path + "'");
+}
+
+class Writer
+{
+public:
+    Writer(HANDLE file, const std::string& path)
+        : file_(file)
+        , path_(path)
+    {
+        batch_.reserve(batch_size);
+    }
+
+    void write(std::string_view chunk)
+    {
+        if (batch_.size() + chunk.size() > batch_size)
+            flush();
+
+        if (chunk.size() >= batch_size)
+            write_all(chunk);
+        else
+            batch_.append(chunk);
+    }
+
+    // There is no copy between files that skips the mapping, the bytes are
+    // written from it like any other piece.
+    void copy(const zest::MappedFile&, size_t, std::string_view chunk)
+    {
+        write(chunk);
+    }
+
+    void flush()
+    {
+        write_all(batch_);
+        batch_.clear();
+    }
+
+private:
+    HANDLE file_;
+    const std::string& path_;
+    std::string batch_;
+
+    void write_all(std::string_view bytes)
+    {
+        while (!bytes.empty())
+        {
+            DWORD size = DWORD(std::min<size_t>(bytes.size(), 1 << 30));
+            DWORD written;
+            if (!WriteFile(file_, bytes.data(), size, &written, NULL))
+                fail(path_);
+            bytes.remove_prefix(written);
+        }
+    }
+};
+
+#else
+
+#ifdef IOV_MAX
+constexpr size_t max_iovecs = IOV_MAX;
+#else
+constexpr size_t max_iovecs = 1024;
+#endif
+
+[[noreturn]] void fail(const std::string& path)
+{
+    throw std::runtime_error("Cannot save file '" + path + "': "
+                             + std::strerror(errno));
+}
+
+// Gathers the pieces into batches written by a single writev each.
+class Writer
+{
+public:
+    Writer(int fd, const std::string& path)
+        : fd_(fd)
+        , path_(path)
+    {
+        iovecs_.reserve(max_iovecs);
+    }
+
+    void write(std::string_view chunk)
+    {
+        if (chunk.empty())
+            return;
+
+        if (iovecs_.size() == max_iovecs)
+            flush();
+        iovecs_.push_back({ (void*)chunk.data(), chunk.size() });
+    }
+
+    // The chunk is the range at offset in the mapped file. Long ones are
+    // copied by the kernel where it can, whatever it cannot copy is
+    // written from the mapping.
+    void copy(const zest::MappedFile& file, size_t offset,
+              std::string_view chunk)
+    {
+#ifdef __linux__
+        if (chunk.size() >= min_copy_length && !copy_failed_)
+        {
+            flush();
+
+            loff_t from = offset;
+            while (!chunk.empty())
+            {
+                ssize_t copied = copy_file_range(file.fd(), &from, fd_,
+                                                 nullptr, chunk.size(), 0);
+                if (copied < 0 && errno == EINTR)
+                    continue;
+
+                // Not supported between these files, a real write error
+                // shows up again in the write.
+                if (copied <= 0)
+                {
+                    copy_failed_ = true;
+                    break;
+                }
+
+                chunk.remove_prefix(copied);
+            }
+        }
+#endif
+
+        write(chunk);
+    }
+
+    void flush()
+    {
+        iovec* iov = iovecs_.data();
+        size_t count = iovecs_.size();
+
+        while (count > 0)
+        {
+            ssize_t written = writev(fd_, iov, int(count));
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+            {
+                if (written == 0)
+                    errno = EIO;
+                fail(path_);
+            }
+
+            // A short write can stop inside an iovec, which then goes on
+            // from there.
+            size_t skipped = written;
+            while (count > 0 && skipped >= iov->iov_len)
+            {
+                skipped -= iov->iov_len;
+                iov++;
+                count--;
+            }
+            if (count > 0)
+            {
+                iov->iov_base = (char*)iov->iov_base + skipped;
+                iov->iov_len -= skipped;
+            }
+        }
+
+        iovecs_.clear();
+    }
+
+private:
+    int fd_;
+    const std::string& path_;
+    std::vector<iovec> iovecs_;
+    bool copy_failed_ = false;
+};
+
+// Makes the rename itself durable. The file is saved already at this
+// point and not every file system syncs directories, so failing is fine.
+void sync_directory(const std::string& path)
+{
+    size_t slash = path.rfind('/');
+    std::string directory = slash == std::string::npos ? "."
+                            : slash == 0               ? "/"
+                                                       : path.substr(0, slash);
+
+    int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+#endif
+
+// Streams the pieces of the text in order, without joining them first.
+void write_text(Writer& writer, const LineBuffer& text)
+{
+    TextSnapshot snapshot = text.snapshot();
+    const zest::MappedFile* original = text.mapped_file().get();
+
+    size_t offset = 0;
+    while (offset < snapshot.size())
+    {
+        std::string_view chunk = snapshot.chunk_at(offset);
+        offset += chunk.size();
+
+        size_t file_offset = original ? offset_in(*original, chunk.data())
+                                      : SIZE_MAX;
+        if (file_offset != SIZE_MAX)
+            writer.copy(*original, file_offset, chunk);
+        else
+            writer.write(chunk);
+    }
+
+    writer.flush();
+}
+
+} // namespace
+
+
+#ifdef _WIN32
+
+void zest::save_file(const LineBuffer& text, const std::string& path)
+{
+    std::string temp;
+    HANDLE file = INVALID_HANDLE_VALUE;
+    for (int attempt = 0;
+         file == INVALID_HANDLE_VALUE && attempt < max_temp_attempts;
+         ++attempt)
+    {
+        temp = temp_path(path, attempt);
+        file = CreateFileA(temp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_NEW,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE
+            && GetLastError() != ERROR_FILE_EXISTS)
+        {
+            fail(path);
+        }
+    }
+    if (file == INVALID_HANDLE_VALUE)
+        fail(path);
+
+    try
+    {
+        Writer writer(file, path);
+        write_text(writer, text);
+
+        if (!FlushFileBuffers(file))
+            fail(path);
+
+        BOOL closed = CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+        if (!closed)
+            fail(path);
+
+        if (!MoveFileExA(temp.c_str(), path.c_str(),
+                         MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+        {
+            fail(path);
+        }
+    }
+    catch (...)
+    {
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        DeleteFileA(temp.c_str());
+        throw;
+    }
+}
+
+#else
+
+void zest::save_file(const LineBuffer& text, const std::string& path)
+{
+    // The rename would replace a symlink with the file, so the file goes
+    // next to its target instead.
+    std::string target = path;
+    if (char* resolved = realpath(path.c_str(), nullptr))
+    {
+        target = resolved;
+        std::free(resolved);
+    }
+
+    struct stat info;
+    bool exists = stat(target.c_str(), &info) == 0;
+
+    std::string temp;
+    int fd = -1;
+    for (int attempt = 0; fd < 0 && attempt < max_temp_attempts; ++attempt)
+    {
+        temp = temp_path(target, attempt);
+        fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                  0666);
+        if (fd < 0 && errno != EEXIST)
+            fail(path);
+    }
+    if (fd < 0)
+        fail(path);
+
+    try
+    {
+        if (exists)
+        {
+            // Only allowed to some users, the others become the owner.
+            [[maybe_unused]] int chowned =
+                fchown(fd, info.st_uid, info.st_gid);
+            if (fchmod(fd, info.st_mode & 07777) != 0)
+                fail(path);
+        }
+
+        Writer writer(fd, path);
+        write_text(writer, text);
+
+        if (fsync(fd) != 0)
+            fail(path);
+
+        int closed = close(fd);
+        fd = -1;
+        if (closed != 0)
+            fail(path);
+
+        if (rename(temp.c_str(), target.c_str()) != 0)
+            fail(path);
+    }
+    catch (...)
+    {
+        if (fd >= 0)
+            close(fd);
+        unlink(temp.c_str());
+        throw;
+    }
+
+    sync_directory(target);
+}
+
+#endif
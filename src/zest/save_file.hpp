@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+class LineBuffer;
+
+namespace zest
+{
+
+// Writes the text to a temporary file next to the path, syncs it to disk
+// and renames it over the path, so the file is either saved completely or
+// left as it was. The pieces of the text are written as they are, without
+// joining them first. Unchanged ranges of a memory-mapped original are
+// copied file to file where the system can, which keeps them out of user
+// space altogether. Throws std::runtime_error on failure.
+//
+// On POSIX systems a symlink is saved through to its target and an
+// existing file keeps its owner and permissions. Windows does not replace
+// a file that is still mapped, load_file never maps files there.
+void save_file(const LineBuffer& text, const std::string& path);
+
+} // namespace zest
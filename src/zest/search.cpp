@@ -0,0 +1,574 @@
+#include "search.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <optional>
+
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ZEST_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+// Runs of a MatchList are split once they get twice this long, so adding
+// matches to one or editing it stays cheap.
+static constexpr size_t max_run_size = 16*1024;
+
+// Small enough that the view's block is done quickly, large enough that
+// handing blocks out costs nothing next to searching them.
+static constexpr size_t block_size = 1024*1024;
+
+#ifdef ZEST_SSE2
+
+static unsigned count_trailing_zeros(uint64_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return index;
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+// Candidates among the 16 starts at data, where both the first and the
+// last byte of the pattern match.
+static uint64_t candidate_mask(const char* data, size_t last_offset,
+                               __m128i first, __m128i last)
+{
+    __m128i block_first = _mm_loadu_si128((const __m128i*)data);
+    __m128i block_last =
+        _mm_loadu_si128((const __m128i*)(data + last_offset));
+
+    __m128i both = _mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                                 _mm_cmpeq_epi8(block_last, last));
+    return _mm_movemask_epi8(both);
+}
+
+#endif
+
+void zest::find_literal(const char* data, size_t size,
+                        std::string_view pattern, size_t base,
+                        std::vector<size_t>& matches)
+{
+    size_t m = pattern.size();
+    if (m == 0 || size < m)
+        return;
+
+    size_t i = 0;
+
+#ifdef ZEST_SSE2
+    const __m128i first = _mm_set1_epi8(pattern[0]);
+    const __m128i last = _mm_set1_epi8(pattern[m - 1]);
+
+    // The last byte of the 64th candidate is at i + 63 + m - 1.
+    for (; i + m - 1 + 64 <= size; i += 64)
+    {
+        uint64_t mask = candidate_mask(data + i, m - 1, first, last)
+            | (candidate_mask(data + i + 16, m - 1, first, last) << 16)
+            | (candidate_mask(data + i + 32, m - 1, first, last) << 32)
+            | (candidate_mask(data + i + 48, m - 1, first, last) << 48);
+
+        while (mask)
+        {
+            size_t candidate = i + count_trailing_zeros(mask);
+            if (m <= 2
+                || std::memcmp(data + candidate + 1, pattern.data() + 1,
+                               m - 2) == 0)
+            {
+                matches.push_back(base + candidate);
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i + m <= size; ++i)
+    {
+        const char* found =
+            (const char*)std::memchr(data + i, pattern[0], size - m + 1 - i);
+        if (!found)
+            return;
+
+        i = found - data;
+        if (std::memcmp(found + 1, pattern.data() + 1, m - 1) == 0)
+            matches.push_back(base + i);
+    }
+}
+
+// Appends the matches in [first, last), relative to base, that do not
+// start inside one of the edits from next on, moved by shift and by what
+// the edits before them add.
+static void move_matches(std::vector<zest::ByteRange>& out, size_t base,
+                         const zest::ByteRange* first,
+                         const zest::ByteRange* last,
+                         const std::vector<zest::ByteEdit>& edits,
+                         size_t next, ptrdiff_t shift)
+{
+    for (; first != last; ++first)
+    {
+        size_t start = base + first->start;
+        for (; next < edits.size() && edits[next].old_end <= start; ++next)
+            shift += ptrdiff_t(edits[next].new_end - edits[next].old_end);
+
+        if (next < edits.size() && start >= edits[next].start)
+            continue;
+
+        out.push_back({ start + shift, base + first->end + shift });
+    }
+}
+
+void zest::update_matches(std::vector<ByteRange>& matches,
+                          const std::vector<ByteEdit>& edits)
+{
+    std::vector<ByteRange> moved;
+    moved.reserve(matches.size());
+    move_matches(moved, 0, matches.data(), matches.data() + matches.size(),
+                 edits, 0, 0);
+    matches.swap(moved);
+}
+
+// Copies the bytes [from, to) of the text, fewer at its end.
+static std::string copy_text(const LineBuffer& text, size_t from, size_t to)
+{
+    std::string copy;
+    for (size_t offset = from; offset < to; )
+    {
+        std::string_view chunk = text.chunk_at(offset);
+        if (chunk.empty())
+            break;
+
+        chunk = chunk.substr(0, to - offset);
+        copy.append(chunk);
+        offset += chunk.size();
+    }
+
+    return copy;
+}
+
+void zest::find_literal(const LineBuffer& text, std::string_view pattern,
+                        size_t from, size_t to,
+                        std::vector<ByteRange>& matches)
+{
+    size_t m = pattern.size();
+    if (m == 0 || from >= to)
+        return;
+
+    // The last start in range needs m - 1 more bytes after it.
+    std::string window = copy_text(text, from, to + m - 1);
+
+    std::vector<size_t> starts;
+    find_literal(window.data(), window.size(), pattern, from, starts);
+
+    for (size_t start : starts)
+        matches.push_back({ start, start + m });
+}
+
+void zest::find_regex(const LineBuffer& text,
+                      const std::shared_ptr<const regex::Regex>& regex,
+                      size_t from, size_t to,
+                      std::vector<ByteRange>& matches)
+{
+    static const std::atomic<bool> never_cancelled = false;
+
+    regex::Matcher matcher(regex);
+
+    size_t offset = from;
+    while (offset < to && offset < text.size())
+    {
+        // Up to the '\n' that ends the line, or the end of the text.
+        std::string line;
+        while (true)
+        {
+            std::string_view chunk = text.chunk_at(offset + line.size());
+            if (chunk.empty())
+                break;
+
+            const char* newline =
+                (const char*)std::memchr(chunk.data(), '\n', chunk.size());
+            if (newline)
+            {
+                line.append(chunk.data(), newline);
+                break;
+            }
+            line.append(chunk);
+        }
+
+        matcher.find_in_line(line, offset, matches, never_cancelled);
+        offset += line.size() + 1;
+    }
+}
+
+void zest::MatchList::find(size_t from, size_t to,
+                           std::vector<ByteRange>& matches) const
+{
+    auto run = std::partition_point(runs_.begin(), runs_.end(),
+                                     [&] (const Run& run)
+                                     {
+                                         return run.last() < from;
+                                     });
+
+    for (; run != runs_.end() && run->first() < to; ++run)
+    {
+        size_t relative = from > run->base ? from - run->base : 0;
+        auto it = std::lower_bound(run->matches.begin(), run->matches.end(),
+                                   ByteRange { relative, 0 });
+
+        for (; it != run->matches.end() && run->base + it->start < to; ++it)
+            matches.push_back({ run->base + it->start,
+                                run->base + it->end });
+    }
+}
+
+std::optional<zest::ByteRange>
+zest::MatchList::first_from(size_t offset) const
+{
+    auto run = std::partition_point(runs_.begin(), runs_.end(),
+                                    [&] (const Run& run)
+                                    {
+                                        return run.last() < offset;
+                                    });
+    if (run == runs_.end())
+        return std::nullopt;
+
+    size_t relative = offset > run->base ? offset - run->base : 0;
+    auto it = std::lower_bound(run->matches.begin(), run->matches.end(),
+                               ByteRange { relative, 0 });
+
+    return ByteRange { run->base + it->start, run->base + it->end };
+}
+
+// Splits the matches, relative to base, into runs of max_run_size, each
+// relative to its first match.
+void zest::MatchList::push_runs(std::vector<Run>& runs, size_t base,
+                                const ByteRange* first,
+                                const ByteRange* last)
+{
+    while (first != last)
+    {
+        size_t count = std::min<size_t>(last - first, max_run_size);
+
+        Run run;
+        run.base = base + first->start;
+        run.matches.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+            run.matches.push_back({ base + first[i].start - run.base,
+                                    base + first[i].end - run.base });
+        runs.push_back(std::move(run));
+
+        first += count;
+    }
+}
+
+void zest::MatchList::insert(const std::vector<ByteRange>& matches)
+{
+    size_t i = 0;
+    while (i < matches.size())
+    {
+        size_t next_run =
+            std::partition_point(runs_.begin(), runs_.end(),
+                                 [&] (const Run& run)
+                                 {
+                                     return run.first() < matches[i].start;
+                                 })
+            - runs_.begin();
+
+        // The matches up to the next run go in front of it.
+        size_t limit = next_run < runs_.size() ? runs_[next_run].first()
+                                               : SIZE_MAX;
+        size_t end = i;
+        while (end < matches.size() && matches[end].start < limit)
+            end++;
+
+        if (next_run > 0 && runs_[next_run - 1].last() > matches[i].start)
+        {
+            // They fall between the matches of the run before, which takes
+            // them in.
+            Run& run = runs_[next_run - 1];
+
+            std::vector<ByteRange> added;
+            added.reserve(end - i);
+            for (size_t j = i; j < end; ++j)
+                added.push_back({ matches[j].start - run.base,
+                                  matches[j].end - run.base });
+
+            std::vector<ByteRange> merged;
+            merged.reserve(run.matches.size() + added.size());
+            std::merge(run.matches.begin(), run.matches.end(),
+                       added.begin(), added.end(),
+                       std::back_inserter(merged));
+
+            if (merged.size() > 2*max_run_size)
+            {
+                std::vector<Run> split;
+                push_runs(split, run.base, merged.data(),
+                          merged.data() + merged.size());
+                runs_.erase(runs_.begin() + (next_run - 1));
+                runs_.insert(runs_.begin() + (next_run - 1),
+                             std::make_move_iterator(split.begin()),
+                             std::make_move_iterator(split.end()));
+            }
+            else
+            {
+                run.matches.swap(merged);
+            }
+        }
+        else
+        {
+            std::vector<Run> added;
+            push_runs(added, 0, matches.data() + i, matches.data() + end);
+            runs_.insert(runs_.begin() + next_run,
+                         std::make_move_iterator(added.begin()),
+                         std::make_move_iterator(added.end()));
+        }
+
+        size_ += end - i;
+        i = end;
+    }
+}
+
+void zest::MatchList::apply_edits(const std::vector<ByteEdit>& edits)
+{
+    if (edits.empty() || runs_.empty())
+        return;
+
+    std::vector<Run> runs;
+    runs.reserve(runs_.size());
+
+    // The edits before next end before the current run and move it along.
+    size_t next = 0;
+    ptrdiff_t shift = 0;
+    for (Run& run : runs_)
+    {
+        for (; next < edits.size() && edits[next].old_end <= run.first();
+             ++next)
+        {
+            shift += ptrdiff_t(edits[next].new_end - edits[next].old_end);
+        }
+
+        if (next == edits.size() || edits[next].start > run.last())
+        {
+            run.base += shift;
+            runs.push_back(std::move(run));
+            continue;
+        }
+
+        std::vector<ByteRange> moved;
+        moved.reserve(run.matches.size());
+        move_matches(moved, run.base, run.matches.data(),
+                     run.matches.data() + run.matches.size(),
+                     edits, next, shift);
+
+        size_ -= run.matches.size() - moved.size();
+        push_runs(runs, 0, moved.data(), moved.data() + moved.size());
+    }
+
+    runs_.swap(runs);
+}
+
+zest::Search::Search(TextSnapshot snapshot,
+                     std::string pattern,
+                     size_t first_offset,
+                     unsigned threads)
+    : snapshot_(std::move(snapshot)),
+      pattern_(std::move(pattern))
+{
+    start(first_offset, threads);
+}
+
+zest::Search::Search(TextSnapshot snapshot,
+                     std::shared_ptr<const regex::Regex> regex,
+                     size_t first_offset,
+                     unsigned threads)
+    : snapshot_(std::move(snapshot)),
+      regex_(std::move(regex))
+{
+    start(first_offset, threads);
+}
+
+void zest::Search::start(size_t first_offset, unsigned threads)
+{
+    block_count_ = (snapshot_.size() + block_size - 1)/block_size;
+    first_block_ = std::min(first_offset/block_size,
+                            block_count_ ? block_count_ - 1 : 0);
+
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    threads = std::min<size_t>(threads, block_count_);
+
+    for (unsigned i = 0; i < threads; ++i)
+        threads_.emplace_back(&Search::run, this);
+}
+
+zest::Search::~Search()
+{
+    cancel();
+    for (std::thread& thread : threads_)
+        thread.join();
+}
+
+std::vector<std::vector<zest::ByteRange>> zest::Search::take_matches()
+{
+    std::vector<std::vector<ByteRange>> blocks;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    blocks.swap(blocks_);
+
+    return blocks;
+}
+
+void zest::Search::run()
+{
+    std::vector<ByteRange> matches;
+
+    std::optional<regex::Matcher> matcher;
+    if (regex_)
+        matcher.emplace(regex_);
+
+    while (!cancelled_)
+    {
+        size_t index = next_block_++;
+        if (index >= block_count_)
+            return;
+
+        // From the view to the end of the text, then the part before it.
+        size_t block = (first_block_ + index) % block_count_;
+
+        if (matcher)
+            search_block_regex(block, *matcher, matches);
+        else
+            search_block(block, matches);
+        if (!matches.empty())
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            blocks_.push_back(std::move(matches));
+        }
+        matches.clear();
+
+        finished_blocks_.fetch_add(1, std::memory_order_release);
+    }
+}
+
+// Reports the matches that start inside the block. The snapshot is made of
+// separate chunks of memory, matches inside a chunk are found in place and
+// only the few starts close enough to the end of a chunk to continue into
+// the next one are checked on a copy.
+void zest::Search::search_block(size_t block,
+                                std::vector<ByteRange>& matches) const
+{
+    size_t m = pattern_.size();
+    std::vector<size_t> starts;
+    size_t from = block*block_size;
+    size_t to = std::min(from + block_size, snapshot_.size());
+
+    size_t offset = from;
+    while (offset < to)
+    {
+        std::string_view chunk = snapshot_.chunk_at(offset);
+        if (chunk.empty())
+            return;
+
+        size_t chunk_end = offset + chunk.size();
+
+        // Starts from here on may run past the end of the chunk.
+        size_t boundary = chunk_end - std::min(chunk.size(), m - 1);
+
+        size_t inner_end = std::min(to, boundary);
+        if (inner_end > offset)
+            find_literal(chunk.data(), inner_end - offset + m - 1, pattern_,
+                         offset, starts);
+
+        size_t boundary_start = std::max(offset, boundary);
+        size_t boundary_end = std::min(to, chunk_end);
+        if (boundary_start < boundary_end)
+        {
+            std::string window(chunk.substr(boundary_start - offset));
+            while (window.size() < boundary_end - boundary_start + m - 1)
+            {
+                std::string_view next =
+                    snapshot_.chunk_at(boundary_start + window.size());
+                if (next.empty())
+                    break;
+                window.append(next.substr(0, m - 1));
+            }
+
+            for (size_t start = boundary_start; start < boundary_end; ++start)
+            {
+                if (window.compare(start - boundary_start, m, pattern_) == 0)
+                    starts.push_back(start);
+            }
+        }
+
+        offset = chunk_end;
+    }
+
+    for (size_t start : starts)
+        matches.push_back({ start, start + m });
+}
+
+// Searches the lines that start in the block, the last one usually ends
+// in the next block. Lines that lie within a chunk are searched in place,
+// the others are copied together first.
+void zest::Search::search_block_regex(size_t block, regex::Matcher& matcher,
+                                      std::vector<ByteRange>& matches) const
+{
+    size_t from = block*block_size;
+    size_t to = std::min(from + block_size, snapshot_.size());
+    size_t size = snapshot_.size();
+
+    // Where the line containing offset ends, at its '\n' or the end of
+    // the text.
+    auto line_end = [&] (size_t offset)
+    {
+        while (offset < size)
+        {
+            std::string_view chunk = snapshot_.chunk_at(offset);
+            const char* newline =
+                (const char*)std::memchr(chunk.data(), '\n', chunk.size());
+            if (newline)
+                return offset + (newline - chunk.data());
+            offset += chunk.size();
+        }
+        return size;
+    };
+
+    size_t offset = from;
+    if (offset > 0 && snapshot_.chunk_at(offset - 1)[0] != '\n')
+        offset = line_end(offset) + 1;
+
+    std::string scratch;
+    while (offset < to)
+    {
+        size_t end = line_end(offset);
+
+        std::string_view line = snapshot_.chunk_at(offset);
+        if (line.size() >= end - offset)
+        {
+            line = line.substr(0, end - offset);
+        }
+        else
+        {
+            scratch.clear();
+            for (size_t i = offset; i < end; )
+            {
+                std::string_view chunk = snapshot_.chunk_at(i);
+                chunk = chunk.substr(0, end - i);
+                scratch.append(chunk);
+                i += chunk.size();
+            }
+            line = scratch;
+        }
+
+        if (!matcher.find_in_line(line, offset, matches, cancelled_))
+            return;
+
+        offset = end + 1;
+    }
+}
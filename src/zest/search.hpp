@@ -0,0 +1,157 @@
+#pragma once
+
+#include <zest/regex.hpp>
+#include <zest/text.hpp>
+#include <zest/types.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace zest
+{
+
+// Appends base + i for every i where pattern occurs at data + i, with the
+// whole occurrence inside [data, data + size). Overlapping occurrences are
+// all reported. Candidates are found 16 bytes at a time by comparing the
+// first and the last byte of the pattern, only those are compared fully.
+void find_literal(const char* data, size_t size, std::string_view pattern,
+                  size_t base, std::vector<size_t>& matches);
+
+// The bytes [start, old_end) of the text became [start, new_end), in the
+// same way as the byte offsets of a TextEdit.
+struct ByteEdit
+{
+    size_t start;
+    size_t old_end;
+    size_t new_end;
+};
+
+// Drops the sorted matches that start inside one of the edits and moves
+// the others along with the text. The edits must be sorted and must not
+// overlap, with offsets into the text before any of them.
+void update_matches(std::vector<ByteRange>& matches,
+                    const std::vector<ByteEdit>& edits);
+
+// The sorted matches that start in [from, to) of the text, searched right
+// away on this thread. Meant for the few bytes around an edit.
+void find_literal(const LineBuffer& text, std::string_view pattern,
+                  size_t from, size_t to, std::vector<ByteRange>& matches);
+
+// Same for a regex, from has to be the start of a line and the lines that
+// start before to are searched to their end.
+void find_regex(const LineBuffer& text,
+                const std::shared_ptr<const regex::Regex>& regex,
+                size_t from, size_t to, std::vector<ByteRange>& matches);
+
+// Sorted matches of a search, kept in runs of a limited length with an
+// offset of their own. Adding the matches of a block only touches the run
+// they fall into, and an edit only rewrites the runs it falls into, the
+// runs after it just move.
+class MatchList
+{
+public:
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // Appends the matches that start in [from, to).
+    void find(size_t from, size_t to, std::vector<ByteRange>& matches) const;
+
+    // The first match that starts at offset or after it.
+    std::optional<ByteRange> first_from(size_t offset) const;
+
+    // Adds sorted matches that are not in the list yet.
+    void insert(const std::vector<ByteRange>& matches);
+
+    // Same as update_matches, for all the matches in the list.
+    void apply_edits(const std::vector<ByteEdit>& edits);
+
+private:
+    struct Run
+    {
+        size_t base;
+
+        // Relative to base, never empty.
+        std::vector<ByteRange> matches;
+
+        size_t first() const { return base + matches.front().start; }
+        size_t last() const { return base + matches.back().start; }
+    };
+
+    std::vector<Run> runs_;
+    size_t size_ = 0;
+
+    static void push_runs(std::vector<Run>& runs, size_t base,
+                          const ByteRange* first, const ByteRange* last);
+};
+
+// Finds the occurrences of a literal pattern or the matches of a regex in
+// a snapshot on a few worker threads. The text is split into blocks that
+// are handed out starting at the block containing first_offset, so
+// matches around the view come in first. Matches can be taken while the
+// search still runs.
+class Search
+{
+public:
+    Search(TextSnapshot snapshot,
+           std::string pattern,
+           size_t first_offset,
+           unsigned threads = 0);
+
+    // Runs line by line, a block takes the lines that start in it.
+    Search(TextSnapshot snapshot,
+           std::shared_ptr<const regex::Regex> regex,
+           size_t first_offset,
+           unsigned threads = 0);
+
+    ~Search();
+
+    Search(const Search&) = delete;
+    Search& operator=(const Search&) = delete;
+
+    // The matches of each block finished since the last call, sorted
+    // within the block. Blocks without matches are left out.
+    std::vector<std::vector<ByteRange>> take_matches();
+
+    // All blocks were searched, though some matches may not be taken yet.
+    bool done() const
+    {
+        return finished_blocks_.load(std::memory_order_acquire)
+               == block_count_;
+    }
+
+    // Stops the workers without waiting for them. Literal searches stop
+    // after the block they are on, regex searches after the line they are
+    // on or 64 KB into a long one, so the destructor never waits long.
+    void cancel() { cancelled_ = true; }
+
+private:
+    TextSnapshot snapshot_;
+    std::string pattern_;
+    std::shared_ptr<const regex::Regex> regex_;
+
+    size_t block_count_;
+    size_t first_block_;
+    std::atomic<size_t> next_block_ = 0;
+    std::atomic<size_t> finished_blocks_ = 0;
+    std::atomic<bool> cancelled_ = false;
+
+    std::mutex mutex_;
+    std::vector<std::vector<ByteRange>> blocks_;
+
+    std::vector<std::thread> threads_;
+
+    void start(size_t first_offset, unsigned threads);
+    void run();
+    void search_block(size_t block, std::vector<ByteRange>& matches) const;
+    void search_block_regex(size_t block, regex::Matcher& matcher,
+                            std::vector<ByteRange>& matches) const;
+};
+
+} // namespace zest
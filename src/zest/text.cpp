@@ -0,0 +1,806 @@
+#include "text.hpp"
+
+#include <zest/mapped_file.hpp>
+#include <zest/newlines.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+
+static constexpr size_t add_block_size = 64*1024;
+
+// Inserted text up to this long is copied again along with more text
+// inserted right after it by a rebuild, instead of staying a piece.
+static constexpr size_t max_recopied_length = 64;
+
+std::string_view TextSnapshot::chunk_at(size_t offset) const
+{
+    if (offset >= size_)
+        return {};
+
+    auto it = std::upper_bound(chunks_.begin(), chunks_.end(), offset,
+                               [] (size_t offset, const Chunk& chunk)
+                               {
+                                   return offset < chunk.offset;
+                               });
+    --it;
+
+    size_t skip = offset - it->offset;
+    return { it->data + skip, it->length - skip };
+}
+
+LineBuffer::LineBuffer()
+    : buffers_(1)
+    , nodes_(1)
+{ }
+
+LineBuffer::LineBuffer(std::string text)
+    : LineBuffer()
+{
+    auto owner = std::make_shared<std::string>(std::move(text));
+    init_original(std::shared_ptr<const char>(owner, owner->data()),
+                  owner->size());
+}
+
+LineBuffer::LineBuffer(std::shared_ptr<const zest::MappedFile> file)
+    : LineBuffer()
+{
+    mapped_file_ = std::move(file);
+    init_original(std::shared_ptr<const char>(mapped_file_,
+                                              mapped_file_->data()),
+                  mapped_file_->size());
+}
+
+std::string_view LineBuffer::get_line(int index) const
+{
+    size_t line = index;
+    size_t start = line_start(line);
+    size_t end = line + 1 < line_count()
+                    ? line_start(line + 1) - 1
+                    : size();
+
+    if (start == end)
+        return {};
+
+    size_t offset = start;
+    const Piece& piece = nodes_[find(offset)].piece;
+
+    if (offset + (end - start) <= piece.length)
+        return { buffers_[piece.buffer].data.get() + piece.start + offset,
+                 end - start };
+
+    scratch_.clear();
+    copy_range(root_, 0, start, end, scratch_);
+
+    return scratch_;
+}
+
+size_t LineBuffer::line_count() const
+{
+    return nodes_[root_].newlines + 1;
+}
+
+size_t LineBuffer::size() const
+{
+    return nodes_[root_].length;
+}
+
+size_t LineBuffer::offset_of(zest::CellPos pos) const
+{
+    return line_start(pos.line) + pos.col;
+}
+
+zest::CellPos LineBuffer::position_of(size_t offset) const
+{
+    offset = std::min(offset, size());
+
+    size_t remaining = offset;
+    size_t line = 0;
+
+    uint32_t node = root_;
+    while (node != nil)
+    {
+        const Node& n = nodes_[node];
+        const Node& left = nodes_[n.left];
+
+        if (remaining < left.length)
+        {
+            node = n.left;
+            continue;
+        }
+
+        remaining -= left.length;
+        line += left.newlines;
+
+        if (remaining < n.piece.length)
+        {
+            line += count_newlines(n.piece.buffer, n.piece.start,
+                                   n.piece.start + remaining);
+            break;
+        }
+
+        remaining -= n.piece.length;
+        line += n.piece.newlines;
+        node = n.right;
+    }
+
+    return { int(line), int(offset - line_start(line)) };
+}
+
+std::string_view LineBuffer::chunk_at(size_t offset) const
+{
+    if (offset >= size())
+        return {};
+
+    const Piece& piece = nodes_[find(offset)].piece;
+
+    return { buffers_[piece.buffer].data.get() + piece.start + offset,
+             piece.length - offset };
+}
+
+zest::TextEdit LineBuffer::insert(size_t offset, std::string_view text)
+{
+    offset = std::min(offset, size());
+
+    zest::TextEdit edit;
+    edit.start_byte = offset;
+    edit.old_end_byte = offset;
+    edit.new_end_byte = offset + text.size();
+    edit.start = position_of(offset);
+    edit.old_end = edit.start;
+    edit.new_end = edit.start;
+
+    for (char c : text)
+    {
+        if (c == '\n')
+        {
+            edit.new_end.line++;
+            edit.new_end.col = 0;
+        }
+        else
+        {
+            edit.new_end.col++;
+        }
+    }
+
+    if (text.empty())
+        return edit;
+
+    Piece piece = append_to_add_buffer(text);
+
+    uint32_t lhs, rhs;
+    split(root_, offset, lhs, rhs);
+
+    if (!extend_last(lhs, piece))
+        lhs = merge(lhs, new_node(piece));
+
+    root_ = merge(lhs, rhs);
+
+    return edit;
+}
+
+zest::TextEdit LineBuffer::insert(zest::CellPos pos, std::string_view text)
+{
+    return insert(offset_of(pos), text);
+}
+
+zest::TextEdit LineBuffer::erase(size_t offset, size_t length)
+{
+    offset = std::min(offset, size());
+    length = std::min(length, size() - offset);
+
+    zest::TextEdit edit;
+    edit.start_byte = offset;
+    edit.old_end_byte = offset + length;
+    edit.new_end_byte = offset;
+    edit.start = position_of(offset);
+    edit.old_end = position_of(offset + length);
+    edit.new_end = edit.start;
+
+    if (length == 0)
+        return edit;
+
+    uint32_t lhs, mid, rhs;
+    split(root_, offset, lhs, mid);
+    split(mid, length, mid, rhs);
+
+    free_subtree(mid);
+    root_ = merge(lhs, rhs);
+
+    return edit;
+}
+
+zest::TextEdit LineBuffer::erase(zest::CellPos from, zest::CellPos to)
+{
+    size_t from_offset = offset_of(from);
+    size_t to_offset = offset_of(to);
+
+    if (to_offset < from_offset)
+        std::swap(from_offset, to_offset);
+
+    return erase(from_offset, to_offset - from_offset);
+}
+
+std::vector<zest::TextEdit> LineBuffer::replace(
+    const std::vector<TextReplacement>& replacements)
+{
+    // Every replacement costs O(log n) on its own, a rebuild O(n) in the
+    // number of pieces for all of them.
+    size_t piece_count = nodes_.size() - 1 - free_nodes_.size();
+    if (replacements.size() > 1 && replacements.size()*16 > piece_count)
+        return rebuild(replacements);
+
+    std::vector<zest::TextEdit> edits;
+    edits.reserve(replacements.size());
+
+    for (auto it = replacements.rbegin(); it != replacements.rend(); ++it)
+    {
+        zest::TextEdit edit = erase(it->start, it->end - it->start);
+
+        zest::TextEdit inserted = insert(it->start, it->text);
+        edit.new_end_byte = inserted.new_end_byte;
+        edit.new_end = inserted.new_end;
+
+        edits.push_back(edit);
+    }
+
+    return edits;
+}
+
+// Collects the pieces in order, splices the replacements in while keeping
+// track of the line and column of the old text, and builds a new treap
+// from the result in linear time.
+std::vector<zest::TextEdit> LineBuffer::rebuild(
+    const std::vector<TextReplacement>& replacements)
+{
+    std::vector<Piece> old_pieces;
+    old_pieces.reserve(nodes_.size());
+
+    std::vector<uint32_t> stack;
+    for (uint32_t node = root_; node != nil || !stack.empty();)
+    {
+        if (node != nil)
+        {
+            stack.push_back(node);
+            node = nodes_[node].left;
+            continue;
+        }
+
+        node = stack.back();
+        stack.pop_back();
+        old_pieces.push_back(nodes_[node].piece);
+        node = nodes_[node].right;
+    }
+
+    std::vector<Piece> pieces;
+    pieces.reserve(old_pieces.size() + 2*replacements.size());
+
+    // Joins pieces that follow each other in a buffer, splits left behind
+    // by earlier edits included.
+    auto push = [&] (const Piece& piece)
+    {
+        if (piece.length == 0)
+            return;
+
+        Piece* last = pieces.empty() ? nullptr : &pieces.back();
+        if (last && last->buffer == piece.buffer
+            && last->start + last->length == piece.start)
+        {
+            last->length += piece.length;
+            last->newlines += piece.newlines;
+        }
+        else
+        {
+            pieces.push_back(piece);
+        }
+    };
+
+    // Where the sweep is in the old text. The start of the line is only
+    // looked up when a replacement needs a column, from the last piece
+    // passed that had a newline.
+    size_t offset = 0;
+    size_t line = 0;
+    Piece newline_piece = {};
+    size_t newline_piece_offset = 0;
+    size_t next = 0;
+    Piece current = old_pieces.empty() ? Piece{} : old_pieces[0];
+
+    auto position = [&] () -> zest::CellPos
+    {
+        size_t line_offset = 0;
+        if (newline_piece.newlines > 0)
+        {
+            const std::vector<size_t>& newlines =
+                buffers_[newline_piece.buffer].newlines;
+            size_t last = *(std::lower_bound(newlines.begin(),
+                                             newlines.end(),
+                                             newline_piece.start
+                                                 + newline_piece.length)
+                            - 1);
+            line_offset = newline_piece_offset
+                          + (last - newline_piece.start) + 1;
+        }
+
+        return { int(line), int(offset - line_offset) };
+    };
+
+    auto consume = [&] (size_t to, bool keep)
+    {
+        while (offset < to && next < old_pieces.size())
+        {
+            size_t length = std::min(current.length, to - offset);
+            Piece part = length == current.length
+                             ? current
+                             : make_piece(current.buffer, current.start,
+                                          length);
+
+            if (keep)
+                push(part);
+
+            if (part.newlines > 0)
+            {
+                line += part.newlines;
+                newline_piece = part;
+                newline_piece_offset = offset;
+            }
+            offset += length;
+
+            if (length == current.length)
+            {
+                if (++next < old_pieces.size())
+                    current = old_pieces[next];
+            }
+            else
+            {
+                current = make_piece(current.buffer, current.start + length,
+                                     current.length - length);
+            }
+        }
+    };
+
+    std::vector<zest::TextEdit> edits(replacements.size());
+
+    for (size_t i = 0; i < replacements.size(); ++i)
+    {
+        const TextReplacement& replacement = replacements[i];
+        zest::TextEdit& edit = edits[replacements.size() - 1 - i];
+
+        consume(replacement.start, true);
+        edit.start_byte = offset;
+        edit.start = position();
+
+        consume(replacement.end, false);
+        edit.old_end_byte = offset;
+        edit.old_end = edit.old_end_byte == edit.start_byte
+                           ? edit.start
+                           : position();
+
+        edit.new_end_byte = edit.start_byte + replacement.text.size();
+        edit.new_end = edit.start;
+        for (char c : replacement.text)
+        {
+            if (c == '\n')
+            {
+                edit.new_end.line++;
+                edit.new_end.col = 0;
+            }
+            else
+            {
+                edit.new_end.col++;
+            }
+        }
+
+        if (replacement.text.empty())
+            continue;
+
+        // Typing at many places at once would leave a new piece at each of
+        // them for every keystroke otherwise.
+        if (!pieces.empty() && pieces.back().buffer != 0
+            && pieces.back().length <= max_recopied_length)
+        {
+            const Piece& last = pieces.back();
+            std::string text(buffers_[last.buffer].data.get() + last.start,
+                             last.length);
+            text += replacement.text;
+
+            pieces.pop_back();
+            push(append_to_add_buffer(text));
+        }
+        else
+        {
+            push(append_to_add_buffer(replacement.text));
+        }
+    }
+
+    consume(SIZE_MAX, true);
+
+    // Every node gets a new priority, a node above all the ones after it
+    // with a lower priority becomes their parent, the way a treap would
+    // have it. A node is done once something with a higher priority comes
+    // after it.
+    nodes_.resize(1);
+    free_nodes_.clear();
+    stack.clear();
+
+    for (const Piece& piece : pieces)
+    {
+        uint32_t node = new_node(piece);
+
+        uint32_t last = nil;
+        while (!stack.empty()
+               && nodes_[stack.back()].priority < nodes_[node].priority)
+        {
+            last = stack.back();
+            stack.pop_back();
+            update(last);
+        }
+        nodes_[node].left = last;
+
+        if (!stack.empty())
+            nodes_[stack.back()].right = node;
+        stack.push_back(node);
+    }
+
+    root_ = stack.empty() ? nil : stack.front();
+    while (!stack.empty())
+    {
+        update(stack.back());
+        stack.pop_back();
+    }
+
+    return edits;
+}
+
+TextSnapshot LineBuffer::snapshot() const
+{
+    TextSnapshot snapshot;
+
+    snapshot.buffers_.reserve(buffers_.size());
+    for (const TextBuffer& buffer : buffers_)
+        snapshot.buffers_.push_back(buffer.data);
+
+    collect_chunks(root_, snapshot);
+
+    return snapshot;
+}
+
+void LineBuffer::init_original(std::shared_ptr<const char> data, size_t size)
+{
+    TextBuffer& original = buffers_[0];
+    original.newlines = zest::find_newlines(data.get(), size);
+    original.data = std::move(data);
+    original.size = size;
+    original.capacity = size;
+
+    if (size > 0)
+        root_ = new_node(make_piece(0, 0, size));
+}
+
+size_t LineBuffer::count_newlines(uint32_t buffer, size_t from, size_t to) const
+{
+    const std::vector<size_t>& newlines = buffers_[buffer].newlines;
+
+    auto first = std::lower_bound(newlines.begin(), newlines.end(), from);
+    auto last = std::lower_bound(first, newlines.end(), to);
+
+    return last - first;
+}
+
+LineBuffer::Piece LineBuffer::make_piece(uint32_t buffer,
+                                         size_t start,
+                                         size_t length) const
+{
+    return { buffer, start, length,
+             count_newlines(buffer, start, start + length) };
+}
+
+LineBuffer::Piece LineBuffer::append_to_add_buffer(std::string_view text)
+{
+    if (buffers_.size() == 1
+        || buffers_.back().capacity - buffers_.back().size < text.size())
+    {
+        size_t capacity = std::max(add_block_size, text.size());
+
+        TextBuffer block;
+        block.data = std::shared_ptr<const char>(new char[capacity],
+                                                 std::default_delete<char[]>());
+        block.capacity = capacity;
+
+        buffers_.push_back(std::move(block));
+    }
+
+    uint32_t index = buffers_.size() - 1;
+    TextBuffer& block = buffers_[index];
+
+    // The block was allocated as mutable memory, only the bytes that are
+    // already referenced by pieces have to stay untouched.
+    char* dest = const_cast<char*>(block.data.get()) + block.size;
+    std::memcpy(dest, text.data(), text.size());
+
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        if (text[i] == '\n')
+            block.newlines.push_back(block.size + i);
+    }
+
+    size_t start = block.size;
+    block.size += text.size();
+
+    return make_piece(index, start, text.size());
+}
+
+uint32_t LineBuffer::new_node(const Piece& piece)
+{
+    seed_ ^= seed_ << 13;
+    seed_ ^= seed_ >> 17;
+    seed_ ^= seed_ << 5;
+
+    uint32_t index;
+    if (!free_nodes_.empty())
+    {
+        index = free_nodes_.back();
+        free_nodes_.pop_back();
+        nodes_[index] = Node{};
+    }
+    else
+    {
+        index = nodes_.size();
+        nodes_.emplace_back();
+    }
+
+    nodes_[index].piece = piece;
+    nodes_[index].priority = seed_;
+    update(index);
+
+    return index;
+}
+
+void LineBuffer::free_subtree(uint32_t node)
+{
+    if (node == nil)
+        return;
+
+    size_t first = free_nodes_.size();
+    free_nodes_.push_back(node);
+
+    for (size_t i = first; i < free_nodes_.size(); ++i)
+    {
+        const Node& n = nodes_[free_nodes_[i]];
+        if (n.left != nil)
+            free_nodes_.push_back(n.left);
+        if (n.right != nil)
+            free_nodes_.push_back(n.right);
+    }
+}
+
+void LineBuffer::update(uint32_t node)
+{
+    Node& n = nodes_[node];
+    n.length = n.piece.length + nodes_[n.left].length + nodes_[n.right].length;
+    n.newlines = n.piece.newlines
+                    + nodes_[n.left].newlines + nodes_[n.right].newlines;
+}
+
+uint32_t LineBuffer::merge(uint32_t lhs, uint32_t rhs)
+{
+    if (lhs == nil)
+        return rhs;
+    if (rhs == nil)
+        return lhs;
+
+    if (nodes_[lhs].priority > nodes_[rhs].priority)
+    {
+        uint32_t right = merge(nodes_[lhs].right, rhs);
+        nodes_[lhs].right = right;
+        update(lhs);
+        return lhs;
+    }
+
+    uint32_t left = merge(lhs, nodes_[rhs].left);
+    nodes_[rhs].left = left;
+    update(rhs);
+    return rhs;
+}
+
+void LineBuffer::split(uint32_t node, size_t offset,
+                       uint32_t& lhs, uint32_t& rhs)
+{
+    if (node == nil)
+    {
+        lhs = rhs = nil;
+        return;
+    }
+
+    size_t left_length = nodes_[nodes_[node].left].length;
+    size_t piece_length = nodes_[node].piece.length;
+
+    if (offset <= left_length)
+    {
+        uint32_t left, right;
+        split(nodes_[node].left, offset, left, right);
+        nodes_[node].left = right;
+        update(node);
+        lhs = left;
+        rhs = node;
+    }
+    else if (offset >= left_length + piece_length)
+    {
+        uint32_t left, right;
+        split(nodes_[node].right, offset - left_length - piece_length,
+              left, right);
+        nodes_[node].right = left;
+        update(node);
+        lhs = node;
+        rhs = right;
+    }
+    else
+    {
+        // The split point is inside of this node's piece, so it is cut in
+        // two. The tail inherits the priority to keep the heap order valid.
+        Piece piece = nodes_[node].piece;
+        size_t cut = offset - left_length;
+
+        uint32_t tail = new_node(make_piece(piece.buffer,
+                                            piece.start + cut,
+                                            piece.length - cut));
+        nodes_[tail].priority = nodes_[node].priority;
+        nodes_[tail].right = nodes_[node].right;
+        update(tail);
+
+        nodes_[node].piece = make_piece(piece.buffer, piece.start, cut);
+        nodes_[node].right = nil;
+        update(node);
+
+        lhs = node;
+        rhs = tail;
+    }
+}
+
+bool LineBuffer::extend_last(uint32_t node, const Piece& piece)
+{
+    if (node == nil)
+        return false;
+
+    Node& n = nodes_[node];
+
+    bool extended = n.right != nil
+                        ? extend_last(n.right, piece)
+                        : n.piece.buffer == piece.buffer
+                            && n.piece.start + n.piece.length == piece.start;
+
+    if (!extended)
+        return false;
+
+    if (n.right == nil)
+    {
+        n.piece.length += piece.length;
+        n.piece.newlines += piece.newlines;
+    }
+    update(node);
+
+    return true;
+}
+
+uint32_t LineBuffer::find(size_t& offset) const
+{
+    uint32_t node = root_;
+    while (node != nil)
+    {
+        const Node& n = nodes_[node];
+        size_t left_length = nodes_[n.left].length;
+
+        if (offset < left_length)
+        {
+            node = n.left;
+            continue;
+        }
+
+        offset -= left_length;
+        if (offset < n.piece.length)
+            return node;
+
+        offset -= n.piece.length;
+        node = n.right;
+    }
+
+    return nil;
+}
+
+size_t LineBuffer::line_start(size_t line) const
+{
+    size_t offset = 0;
+
+    uint32_t node = root_;
+    while (node != nil && line > 0)
+    {
+        const Node& n = nodes_[node];
+        const Node& left = nodes_[n.left];
+
+        if (line <= left.newlines)
+        {
+            node = n.left;
+            continue;
+        }
+
+        line -= left.newlines;
+        offset += left.length;
+
+        if (line <= n.piece.newlines)
+        {
+            const std::vector<size_t>& newlines =
+                buffers_[n.piece.buffer].newlines;
+            auto first = std::lower_bound(newlines.begin(), newlines.end(),
+                                          n.piece.start);
+            return offset + *(first + (line - 1)) - n.piece.start + 1;
+        }
+
+        line -= n.piece.newlines;
+        offset += n.piece.length;
+        node = n.right;
+    }
+
+    return offset;
+}
+
+void LineBuffer::copy_range(uint32_t node, size_t base,
+                            size_t from, size_t to, std::string& out) const
+{
+    if (node == nil || from >= to)
+        return;
+
+    const Node& n = nodes_[node];
+    size_t piece_begin = base + nodes_[n.left].length;
+    size_t piece_end = piece_begin + n.piece.length;
+
+    if (from < piece_begin)
+        copy_range(n.left, base, from, to, out);
+
+    size_t first = std::max(from, piece_begin);
+    size_t last = std::min(to, piece_end);
+    if (first < last)
+        out.append(buffers_[n.piece.buffer].data.get()
+                        + n.piece.start + (first - piece_begin),
+                   last - first);
+
+    if (to > piece_end)
+        copy_range(n.right, piece_end, from, to, out);
+}
+
+void LineBuffer::collect_chunks(uint32_t node, TextSnapshot& snapshot) const
+{
+    if (node == nil)
+        return;
+
+    const Node& n = nodes_[node];
+
+    collect_chunks(n.left, snapshot);
+
+    snapshot.chunks_.push_back({
+        snapshot.size_,
+        buffers_[n.piece.buffer].data.get() + n.piece.start,
+        n.piece.length
+    });
+    snapshot.size_ += n.piece.length;
+
+    collect_chunks(n.right, snapshot);
+}
+
+LineBuffer load_file(const std::string& path, size_t map_threshold)
+{
+    std::ifstream input_stream(path, std::ios::binary | std::ios::ate);
+
+    if (!input_stream)
+        throw std::runtime_error("Cannot open file '" + path + "'");
+
+    size_t size = input_stream.tellg();
+    if (size >= map_threshold)
+        return LineBuffer(std::make_shared<const zest::MappedFile>(path));
+
+    std::string text(size, '\0');
+    input_stream.seekg(0);
+    input_stream.read(text.data(), text.size());
+
+    return LineBuffer(std::move(text));
+}
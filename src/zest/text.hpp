@@ -1,63 +1,187 @@
 #pragma once
 
-#include <fstream>
-#include <stdexcept>
+#include <zest/types.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
+namespace zest
+{
+class MappedFile;
+}
+
+
+// Files at least this large are memory-mapped instead of read into memory.
+// Windows does not replace a file that is still mapped, which is how it is
+// saved, so files are always read into memory there.
+#ifdef _WIN32
+constexpr size_t mmap_threshold = SIZE_MAX;
+#else
+constexpr size_t mmap_threshold = 8*1024*1024;
+#endif
 
-template<typename Line>
-class LineBufferImpl
+// A block of text referenced by the pieces of a LineBuffer. Bytes are only
+// ever appended to a buffer and never modified afterwards, so views into
+// it stay valid for as long as the buffer itself is alive.
+struct TextBuffer
+{
+    std::shared_ptr<const char> data;
+    size_t size = 0;
+    size_t capacity = 0;
+
+    // Offsets of all the '\n' characters in [0, size).
+    std::vector<size_t> newlines;
+};
+
+// Immutable copy of the piece sequence of a LineBuffer. It shares the
+// underlying buffers, so it is cheap to take and can be read from another
+// thread while the LineBuffer keeps being edited.
+class TextSnapshot
 {
 public:
-    const Line& get_line(int index) const { return lines_[index]; }
-    Line& get_line(int index) { return lines_[index]; }
+    size_t size() const { return size_; }
 
-    size_t line_count() const { return lines_.size(); }
+    // Longest run of contiguous text starting at the given offset. Empty
+    // when the offset is at the end of the text.
+    std::string_view chunk_at(size_t offset) const;
 
-    void add_line(int index, const std::string& line)
-    {
-        if (index == lines_.size())
-        {
-            lines_.push_back(line);
-            return;
-        }
-
-        size_t old_size = lines_.size();
-        lines_.resize(lines_.size() + 1);
-
-        for (int i = old_size; i > index; --i)
-        {
-            lines_[i - 1] = std::move(lines_[i]);
-        }
-        lines_[index] = line;
-    }
+private:
+    friend class LineBuffer;
 
-    void append_line(const std::string& line)
+    struct Chunk
     {
-        add_line(line_count(), line);
-    }
+        size_t offset;
+        const char* data;
+        size_t length;
+    };
 
-private:
-    std::vector<Line> lines_;
+    std::vector<std::shared_ptr<const char>> buffers_;
+    std::vector<Chunk> chunks_;
+    size_t size_ = 0;
 };
 
-using LineBuffer = LineBufferImpl<std::string>;
+// The bytes [start, end) of the text become text.
+struct TextReplacement
+{
+    size_t start;
+    size_t end;
+    std::string_view text;
+};
 
-inline LineBuffer load_file(const std::string& path)
+// Text storage implemented as a piece table. The original file content is
+// kept in one read-only buffer and everything inserted later is appended to
+// add buffers. The document is the in-order sequence of pieces stored in a
+// treap, where every node also keeps the length and the number of newlines
+// of its subtree. That doubles as the line index, so both edits and line
+// lookups are O(log n) in the number of pieces.
+class LineBuffer
 {
-    std::ifstream input_stream(path);
+public:
+    LineBuffer();
+    explicit LineBuffer(std::string text);
+
+    // The buffer points straight into the mapping, only text inserted later
+    // is copied.
+    explicit LineBuffer(std::shared_ptr<const zest::MappedFile> file);
+
+    // The returned view is invalidated by the next edit or the next call to
+    // get_line, whichever comes first.
+    std::string_view get_line(int index) const;
+    size_t line_count() const;
+
+    // Total size of the text in bytes.
+    size_t size() const;
 
-    if (!input_stream)
-        throw std::runtime_error("Cannot open file '" + path + "'");
+    size_t offset_of(zest::CellPos pos) const;
+    zest::CellPos position_of(size_t offset) const;
 
-    LineBuffer buffer;
+    // Longest run of contiguous text starting at the given offset. Empty
+    // when the offset is at the end of the text.
+    std::string_view chunk_at(size_t offset) const;
 
-    std::string line;
-    while (std::getline(input_stream, line))
+    zest::TextEdit insert(size_t offset, std::string_view text);
+    zest::TextEdit insert(zest::CellPos pos, std::string_view text);
+
+    zest::TextEdit erase(size_t offset, size_t length);
+    zest::TextEdit erase(zest::CellPos from, zest::CellPos to);
+
+    // Makes all the replacements as a single edit. They must be sorted and
+    // must not overlap, with offsets into the text before any of them.
+    // Returns their edits sorted by the start, last first, all positions
+    // from before any of them, which is how they apply one after another.
+    // Many replacements at once rebuild the pieces in a single pass instead
+    // of editing the treap for each of them.
+    std::vector<zest::TextEdit> replace(
+        const std::vector<TextReplacement>& replacements);
+
+    // O(number of pieces).
+    TextSnapshot snapshot() const;
+
+    // The file backing the original text, if it was memory-mapped.
+    const std::shared_ptr<const zest::MappedFile>& mapped_file() const
     {
-        buffer.append_line(line);
+        return mapped_file_;
     }
 
-    return buffer;
-}
+private:
+    struct Piece
+    {
+        uint32_t buffer;
+        size_t start;
+        size_t length;
+        size_t newlines;
+    };
+
+    struct Node
+    {
+        Piece piece;
+        uint32_t left = 0;
+        uint32_t right = 0;
+        uint32_t priority = 0;
+
+        // Aggregates over the whole subtree rooted in this node.
+        size_t length = 0;
+        size_t newlines = 0;
+    };
+
+    // Index 0 is a sentinel with empty aggregates and stands for no node.
+    static constexpr uint32_t nil = 0;
+
+    std::shared_ptr<const zest::MappedFile> mapped_file_;
+    std::vector<TextBuffer> buffers_;
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> free_nodes_;
+    uint32_t root_ = nil;
+    uint32_t seed_ = 0x2545f491;
+
+    mutable std::string scratch_;
+
+    void init_original(std::shared_ptr<const char> data, size_t size);
+
+    size_t count_newlines(uint32_t buffer, size_t from, size_t to) const;
+    Piece make_piece(uint32_t buffer, size_t start, size_t length) const;
+    Piece append_to_add_buffer(std::string_view text);
+
+    uint32_t new_node(const Piece& piece);
+    void free_subtree(uint32_t node);
+    void update(uint32_t node);
+
+    uint32_t merge(uint32_t lhs, uint32_t rhs);
+    void split(uint32_t node, size_t offset, uint32_t& lhs, uint32_t& rhs);
+    bool extend_last(uint32_t node, const Piece& piece);
+    std::vector<zest::TextEdit> rebuild(
+        const std::vector<TextReplacement>& replacements);
+
+    uint32_t find(size_t& offset) const;
+    size_t line_start(size_t line) const;
+    void copy_range(uint32_t node, size_t base,
+                    size_t from, size_t to, std::string& out) const;
+    void collect_chunks(uint32_t node, TextSnapshot& snapshot) const;
+};
+
+LineBuffer load_file(const std::string& path,
+                     size_t map_threshold = mmap_threshold);
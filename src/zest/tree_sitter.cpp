@@ -3,7 +3,10 @@
 #include <zest/highlight/captures.hpp>
 #include <zest/highlight/queries.hpp>
 
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <string_view>
 
 
 using namespace zest::tree_sitter;
@@ -11,31 +14,30 @@ using namespace zest::tree_sitter;
 
 extern "C" TSLanguage* tree_sitter_cpp();
 
-static char newline = '\n';
-
 static const char* get_text_chunk(void* payload,
                                   uint32_t byte_index,
-                                  TSPoint position,
+                                  TSPoint,
                                   uint32_t* bytes_read)
 {
     const LineBuffer& line_buff = *(LineBuffer*)payload;
 
-    if (position.row >= line_buff.line_count())
-    {
-        *bytes_read = 0;
-        return nullptr;
-    }
+    std::string_view chunk = line_buff.chunk_at(byte_index);
 
-    const std::string* row = &line_buff.get_line(position.row);
+    *bytes_read = chunk.size();
+    return chunk.data();
+}
 
-    if (position.column == row->size())
-    {
-        *bytes_read = 1;
-        return &newline;
-    }
+static const char* get_snapshot_chunk(void* payload,
+                                      uint32_t byte_index,
+                                      TSPoint,
+                                      uint32_t* bytes_read)
+{
+    const TextSnapshot& snapshot = *(TextSnapshot*)payload;
+
+    std::string_view chunk = snapshot.chunk_at(byte_index);
 
-    *bytes_read = row->size() - position.column;
-    return row->c_str() + position.column;
+    *bytes_read = chunk.size();
+    return chunk.data();
 }
 
 ParserPtr zest::tree_sitter::init()
@@ -45,9 +47,27 @@ ParserPtr zest::tree_sitter::init()
     return parser;
 }
 
-QueryPtr zest::tree_sitter::init_highlight_queries(const TSParser* parser)
+static uint8_t resolve_capture_color(std::string_view name)
 {
-        const TSLanguage* lang = ts_parser_language(parser);
+    while (true)
+    {
+        for (size_t i = 0; i < std::size(zest::highlight::highlights); ++i)
+        {
+            if (zest::highlight::highlights[i].name == name)
+                return i;
+        }
+
+        size_t dot = name.rfind('.');
+        if (dot == std::string_view::npos)
+            return zest::highlight::no_color;
+
+        name = name.substr(0, dot);
+    }
+}
+
+HighlightQueries zest::tree_sitter::init_highlight_queries(const TSParser* parser)
+{
+    const TSLanguage* lang = ts_parser_language(parser);
 
     uint32_t err_offset;
     TSQueryError err_type;
@@ -85,8 +105,26 @@ QueryPtr zest::tree_sitter::init_highlight_queries(const TSParser* parser)
         throw std::runtime_error("Failed to load queries.");
     }
 
-    return zest::tree_sitter::QueryPtr(raw_query,
-                                       zest::tree_sitter::delete_query);
+    HighlightQueries queries;
+    queries.query = QueryPtr(raw_query, delete_query);
+
+    uint32_t capture_count = ts_query_capture_count(raw_query);
+    queries.capture_colors.resize(capture_count);
+
+    for (uint32_t i = 0; i < capture_count; ++i)
+    {
+        uint32_t name_len;
+        const char* name = ts_query_capture_name_for_id(raw_query, i, &name_len);
+
+        queries.capture_colors[i] =
+            resolve_capture_color(std::string_view(name, name_len));
+
+        if (queries.capture_colors[i] == zest::highlight::no_color)
+            std::cerr << "No color for capture '"
+                      << std::string_view(name, name_len) << "'\n";
+    }
+
+    return queries;
 }
 
 QueryCursorPtr zest::tree_sitter::init_query_cursor()
@@ -96,16 +134,53 @@ QueryCursorPtr zest::tree_sitter::init_query_cursor()
             zest::tree_sitter::delete_query_cursor);
 }
 
-TreePtr zest::tree_sitter::parse_text(TSParser* parser, LineBuffer& line_buff)
+TreePtr zest::tree_sitter::parse_text(TSParser* parser,
+                                     const LineBuffer& line_buff,
+                                     const TSTree* old_tree)
 {
     TSInput input{
-        &line_buff,
+        (void*)&line_buff,
         get_text_chunk,
         TSInputEncodingUTF8
     };
 
     ts_parser_reset(parser);
-    TSTree* tree_raw = ts_parser_parse(parser, NULL, input);
+    TSTree* tree_raw = ts_parser_parse(parser, old_tree, input);
 
     return TreePtr(tree_raw, delete_tree);
 }
+
+TreePtr zest::tree_sitter::parse_text(TSParser* parser,
+                                     const TextSnapshot& snapshot,
+                                     const TSTree* old_tree)
+{
+    TSInput input{
+        (void*)&snapshot,
+        get_snapshot_chunk,
+        TSInputEncodingUTF8
+    };
+
+    ts_parser_reset(parser);
+    TSTree* tree_raw = ts_parser_parse(parser, old_tree, input);
+
+    return TreePtr(tree_raw, delete_tree);
+}
+
+static TSPoint to_point(zest::CellPos pos)
+{
+    return { uint32_t(pos.line), uint32_t(pos.col) };
+}
+
+void zest::tree_sitter::edit_tree(TSTree* tree, const zest::TextEdit& edit)
+{
+    TSInputEdit input_edit{
+        uint32_t(edit.start_byte),
+        uint32_t(edit.old_end_byte),
+        uint32_t(edit.new_end_byte),
+        to_point(edit.start),
+        to_point(edit.old_end),
+        to_point(edit.new_end)
+    };
+
+    ts_tree_edit(tree, &input_edit);
+}
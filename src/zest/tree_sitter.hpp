@@ -1,10 +1,13 @@
 #pragma once
 
 #include <zest/text.hpp>
+#include <zest/types.hpp>
 
 #include <tree_sitter/api.h>
 
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 namespace zest
 {
@@ -39,11 +42,27 @@ using QueryCursorPtr = std::unique_ptr<TSQueryCursor,
                                        decltype(delete_query_cursor)*>;
 
 
+struct HighlightQueries
+{
+    QueryPtr query { nullptr, delete_query };
+
+    // Index into zest::highlight::highlights for every capture id of the
+    // query, zest::highlight::no_color for captures without a color.
+    std::vector<uint8_t> capture_colors;
+};
+
 ParserPtr init();
-QueryPtr init_highlight_queries(const TSParser* parser);
+HighlightQueries init_highlight_queries(const TSParser* parser);
 QueryCursorPtr init_query_cursor();
 
-TreePtr parse_text(TSParser* parser, LineBuffer& line_buff);
+// When old_tree is given it must already reflect all edits made since it
+// was parsed, only the changed parts are reparsed then.
+TreePtr parse_text(TSParser* parser, const LineBuffer& line_buff,
+                   const TSTree* old_tree = nullptr);
+TreePtr parse_text(TSParser* parser, const TextSnapshot& snapshot,
+                   const TSTree* old_tree = nullptr);
+
+void edit_tree(TSTree* tree, const zest::TextEdit& edit);
 
 
 } // namespace tree_sitter
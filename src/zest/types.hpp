@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 namespace zest
@@ -16,6 +17,48 @@ struct CellPos
     int col;
 };
 
+inline bool operator!=(CellPos lhs, CellPos rhs)
+{
+    return lhs.line != rhs.line || lhs.col != rhs.col;
+}
+
+inline bool operator==(CellPos lhs, CellPos rhs)
+{
+    return !(lhs != rhs);
+}
+
+// Earlier in the text.
+inline bool operator<(CellPos lhs, CellPos rhs)
+{
+    return lhs.line < rhs.line
+           || (lhs.line == rhs.line && lhs.col < rhs.col);
+}
+
+// Bytes [start, end) of the text.
+struct ByteRange
+{
+    size_t start;
+    size_t end;
+};
+
+inline bool operator<(ByteRange lhs, ByteRange rhs)
+{
+    return lhs.start < rhs.start
+           || (lhs.start == rhs.start && lhs.end < rhs.end);
+}
+
+// A single change of the text, both in bytes and in cell positions.
+struct TextEdit
+{
+    size_t start_byte;
+    size_t old_end_byte;
+    size_t new_end_byte;
+
+    CellPos start;
+    CellPos old_end;
+    CellPos new_end;
+};
+
 struct Rect
 {
     float x, y;
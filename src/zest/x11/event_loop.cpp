@@ -0,0 +1,84 @@
+#include "event_loop.hpp"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+#include <cstring>
+
+
+zest::x11::EventLoop::EventLoop(xcb_connection_t* connection,
+                                int blink_interval_ms)
+    : connection_(connection),
+      blink_interval_ms_(blink_interval_ms)
+{
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (timer_fd_ < 0 || event_fd_ < 0)
+    {
+        std::string error = std::strerror(errno);
+        if (timer_fd_ >= 0)
+            close(timer_fd_);
+        if (event_fd_ >= 0)
+            close(event_fd_);
+        throw std::runtime_error("Failed to create the event loop: " + error);
+    }
+
+    restart_blink();
+}
+
+zest::x11::EventLoop::~EventLoop()
+{
+    close(timer_fd_);
+    close(event_fd_);
+}
+
+zest::x11::EventLoop::Wakeup zest::x11::EventLoop::wait()
+{
+    pollfd fds[3] = {
+        { xcb_get_file_descriptor(connection_), POLLIN, 0 },
+        { timer_fd_, POLLIN, 0 },
+        { event_fd_, POLLIN, 0 },
+    };
+
+    while (poll(fds, 3, -1) < 0 && errno == EINTR)
+    { }
+
+    Wakeup wakeup;
+
+    uint64_t count;
+    if ((fds[1].revents & POLLIN)
+        && read(timer_fd_, &count, sizeof(count)) == sizeof(count))
+    {
+        wakeup.blinks = count;
+    }
+
+    if ((fds[2].revents & POLLIN)
+        && read(event_fd_, &count, sizeof(count)) == sizeof(count))
+    {
+        wakeup.notified = true;
+    }
+
+    return wakeup;
+}
+
+void zest::x11::EventLoop::restart_blink()
+{
+    timespec interval = {
+        blink_interval_ms_/1000, (blink_interval_ms_%1000)*1000000L
+    };
+    itimerspec spec = { interval, interval };
+    timerfd_settime(timer_fd_, 0, &spec, nullptr);
+}
+
+void zest::x11::EventLoop::notify()
+{
+    uint64_t one = 1;
+    while (write(event_fd_, &one, sizeof(one)) < 0 && errno == EINTR)
+    { }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <xcb/xcb.h>
+
+#include <cstdint>
+
+namespace zest
+{
+
+namespace x11
+{
+
+// Sleeps until there is something to do: input on the X connection, a
+// tick of the cursor blink timer or a wakeup from a background thread.
+// Built on poll over the connection fd, a timerfd and an eventfd, so an
+// idle editor does not wake up at all between blinks.
+class EventLoop
+{
+public:
+    EventLoop(xcb_connection_t* connection, int blink_interval_ms);
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    struct Wakeup
+    {
+        // Number of blink intervals that passed since the last wait.
+        uint64_t blinks = 0;
+
+        // Some background thread called notify.
+        bool notified = false;
+    };
+
+    // Blocks until at least one thing happened. Must only be called when
+    // xcb has no queued events, poll does not see those.
+    Wakeup wait();
+
+    // Starts the blink interval over, e.g. after the cursor moved.
+    void restart_blink();
+
+    // Wakes up wait. Safe to call from any thread.
+    void notify();
+
+private:
+    xcb_connection_t* connection_;
+    int blink_interval_ms_;
+
+    int timer_fd_ = -1;
+    int event_fd_ = -1;
+};
+
+} // namespace x11
+
+} // namespace zest
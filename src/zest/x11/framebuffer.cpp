@@ -0,0 +1,167 @@
+#include "framebuffer.hpp"
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+
+zest::x11::FrameBuffer::FrameBuffer(xcb_connection_t* connection,
+                                    xcb_window_t window,
+                                    xcb_gcontext_t gc,
+                                    uint8_t depth)
+    : connection_(connection),
+      window_(window),
+      gc_(gc),
+      depth_(depth)
+{
+    // Z pixmaps of depth 24 are 32 bits per pixel, so with the least
+    // significant byte first the bytes in memory are B, G, R, X.
+    const xcb_setup_t* setup = xcb_get_setup(connection_);
+    bgra_ = setup->image_byte_order == XCB_IMAGE_ORDER_LSB_FIRST;
+    if (!bgra_)
+        std::cerr << "Most significant byte first images are not "
+                     "supported, colors will be wrong.\n";
+
+    const xcb_query_extension_reply_t* extension =
+        xcb_get_extension_data(connection_, &xcb_shm_id);
+    if (!extension || !extension->present)
+        return;
+
+    xcb_shm_query_version_reply_t* version = xcb_shm_query_version_reply(
+        connection_, xcb_shm_query_version(connection_), nullptr);
+    if (!version)
+        return;
+    std::free(version);
+
+    // Shared memory only works with a server on the same machine, that is
+    // found out when the first segment is attached.
+    shm_available_ = true;
+    shm_completion_ = extension->first_event + XCB_SHM_COMPLETION;
+}
+
+zest::x11::FrameBuffer::~FrameBuffer()
+{
+    detach_segment();
+}
+
+void zest::x11::FrameBuffer::resize(int width, int height)
+{
+    width_ = std::max(width, 1);
+    height_ = std::max(height, 1);
+
+    size_t size = size_t(width_)*height_*4;
+
+    detach_segment();
+    if (shm_available_ && !attach_segment(size))
+    {
+        std::cerr << "MIT-SHM is not usable, falling back to put_image.\n";
+        shm_available_ = false;
+    }
+
+    if (uses_shm())
+        std::vector<uint32_t>().swap(pixels_);
+    else
+        pixels_.assign(size_t(width_)*height_, 0);
+}
+
+zest::Surface zest::x11::FrameBuffer::surface()
+{
+    uint8_t* pixels = uses_shm() ? shm_pixels_ : (uint8_t*)pixels_.data();
+    return { pixels, width_, height_, size_t(width_)*4, bgra_ };
+}
+
+void zest::x11::FrameBuffer::present(int top, int bot)
+{
+    top = std::max(top, 0);
+    bot = std::min(bot, height_);
+    if (top >= bot)
+        return;
+
+    size_t stride = size_t(width_)*4;
+
+    if (uses_shm())
+    {
+        // Asks for a completion event, so that we know when the rows may
+        // be drawn into again.
+        xcb_shm_put_image(connection_, window_, gc_,
+                          width_, height_,
+                          0, top, width_, bot - top,
+                          0, top,
+                          depth_, XCB_IMAGE_FORMAT_Z_PIXMAP,
+                          1, segment_, 0);
+        pending_++;
+        return;
+    }
+
+    // The limit is in units of 4 bytes and includes the request header.
+    size_t max_bytes = size_t(xcb_get_maximum_request_length(connection_))*4;
+    size_t header_size = sizeof(xcb_put_image_request_t);
+    int rows_per_request = std::max<size_t>(1, (max_bytes - header_size)/stride);
+
+    const uint8_t* pixels = (const uint8_t*)pixels_.data();
+    for (int y = top; y < bot; y += rows_per_request)
+    {
+        int rows = std::min(rows_per_request, bot - y);
+        xcb_put_image(connection_, XCB_IMAGE_FORMAT_Z_PIXMAP,
+                      window_, gc_,
+                      width_, rows,
+                      0, y,
+                      0, depth_,
+                      rows*stride,
+                      pixels + y*stride);
+    }
+}
+
+bool zest::x11::FrameBuffer::handle_event(const xcb_generic_event_t* event)
+{
+    if (!uses_shm() || (event->response_type & 0x7f) != shm_completion_)
+        return false;
+
+    pending_ = std::max(pending_ - 1, 0);
+    return true;
+}
+
+bool zest::x11::FrameBuffer::attach_segment(size_t size)
+{
+    int id = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if (id < 0)
+        return false;
+
+    void* pixels = shmat(id, nullptr, 0);
+    if (pixels == (void*)-1)
+    {
+        shmctl(id, IPC_RMID, nullptr);
+        return false;
+    }
+
+    segment_ = xcb_generate_id(connection_);
+    xcb_generic_error_t* error = xcb_request_check(
+        connection_, xcb_shm_attach_checked(connection_, segment_, id, 0));
+
+    // The segment goes away once both sides detach from it, even if we
+    // crash.
+    shmctl(id, IPC_RMID, nullptr);
+
+    if (error)
+    {
+        std::free(error);
+        shmdt(pixels);
+        return false;
+    }
+
+    shm_pixels_ = (uint8_t*)pixels;
+    return true;
+}
+
+void zest::x11::FrameBuffer::detach_segment()
+{
+    if (!shm_pixels_)
+        return;
+
+    xcb_shm_detach(connection_, segment_);
+    shmdt(shm_pixels_);
+    shm_pixels_ = nullptr;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <zest/raster.hpp>
+
+#include <xcb/xcb.h>
+#include <xcb/shm.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace zest
+{
+
+namespace x11
+{
+
+// Window contents drawn in software. When the server supports MIT-SHM the
+// pixels live in a shared memory segment and presenting only tells the
+// server which rows to copy from it. Otherwise they are sent with plain
+// put_image requests, split so that each one fits the request size limit.
+class FrameBuffer
+{
+public:
+    FrameBuffer(xcb_connection_t* connection,
+                xcb_window_t window,
+                xcb_gcontext_t gc,
+                uint8_t depth);
+    ~FrameBuffer();
+
+    FrameBuffer(const FrameBuffer&) = delete;
+    FrameBuffer& operator=(const FrameBuffer&) = delete;
+
+    // Contents are lost, the caller has to draw everything again. Must not
+    // be called while busy.
+    void resize(int width, int height);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    zest::Surface surface();
+
+    // Copies the rows [top, bot) to the window. The request is only
+    // queued, the caller flushes the connection.
+    void present(int top, int bot);
+
+    // With MIT-SHM the server reads the pixels some time after the request
+    // was sent, they must not be drawn into until it says it is done.
+    bool busy() const { return pending_ > 0; }
+
+    // Returns true when the event was meant for the frame buffer.
+    bool handle_event(const xcb_generic_event_t* event);
+
+    bool uses_shm() const { return shm_pixels_ != nullptr; }
+
+private:
+    xcb_connection_t* connection_;
+    xcb_window_t window_;
+    xcb_gcontext_t gc_;
+    uint8_t depth_;
+    bool bgra_;
+
+    int width_ = 0;
+    int height_ = 0;
+
+    bool shm_available_ = false;
+    uint8_t shm_completion_ = 0;
+    xcb_shm_seg_t segment_ = 0;
+    uint8_t* shm_pixels_ = nullptr;
+    int pending_ = 0;
+
+    std::vector<uint32_t> pixels_;
+
+    bool attach_segment(size_t size);
+    void detach_segment();
+};
+
+} // namespace x11
+
+} // namespace zest
@@ -1,7 +1,22 @@
+#include <zest/bdf.hpp>
+#include <zest/glyph_atlas.hpp>
+#include <zest/line_damage.hpp>
+#include <zest/parse_worker.hpp>
+#include <zest/raster.hpp>
+#include <zest/text.hpp>
+#include <zest/tree_sitter.hpp>
+#include <zest/highlight/cache.hpp>
+#include <zest/highlight/captures.hpp>
+#include <zest/x11/event_loop.hpp>
+#include <zest/x11/framebuffer.hpp>
+
+#include <algorithm>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
 #include <vector>
-#include <chrono>
-#include <thread>
 
 #include <xcb/xcb.h>
 
@@ -19,17 +34,61 @@ struct XcbWindow
     xcb_visualid_t visual_id;
 
     xcb_gcontext_t gc;
-    std::vector<uint32_t> backbuffer;
 
     int width;
     int height;
+};
 
-    void resize(int new_width, int new_height)
-    {
-        backbuffer = std::vector<uint32_t>(new_width*new_height, 0);
-        width = new_width;
-        height = new_height;
-    }
+// Everything needed to show the text, drawn into the frame buffer line by
+// line. Only the lines in damage are drawn again and presented.
+struct TextView
+{
+    LineBuffer line_buffer;
+
+    std::shared_ptr<const zest::BitmapFont> font;
+    std::unique_ptr<zest::GlyphAtlas> atlas;
+
+    int first_line = 0;
+    zest::LineDamage damage;
+
+    int cursor_line = 0;
+    int cursor_col = 0;
+    bool cursor_visible = true;
+
+    zest::tree_sitter::HighlightQueries queries;
+    zest::tree_sitter::QueryCursorPtr query_cursor {
+        nullptr, zest::tree_sitter::delete_query_cursor };
+    std::unique_ptr<zest::tree_sitter::ParseWorker> parse_worker;
+    zest::tree_sitter::TreePtr tree {
+        nullptr, zest::tree_sitter::delete_tree };
+    zest::highlight::SpanCache highlight_cache;
+};
+
+static constexpr zest::Color background_color = { 0, 121, 241, 255 };
+static constexpr zest::Color text_color = { 255, 255, 255, 255 };
+static constexpr zest::Color cursor_color = { 255, 255, 255, 255 };
+static constexpr int cursor_width = 2;
+static constexpr int blink_interval_ms = 500;
+static constexpr int highlight_margin = 64;
+static constexpr int scroll_lines = 3;
+
+// The keysyms of every keycode, as the server maps them. Only the first
+// keysym of each keycode is used, modifiers are not handled yet.
+struct Keymap
+{
+    xcb_keycode_t min_keycode = 0;
+    uint8_t keysyms_per_keycode = 0;
+    std::vector<xcb_keysym_t> keysyms;
+};
+
+enum : xcb_keysym_t
+{
+    keysym_left = 0xff51,
+    keysym_up = 0xff52,
+    keysym_right = 0xff53,
+    keysym_down = 0xff54,
+    keysym_page_up = 0xff55,
+    keysym_page_down = 0xff56,
 };
 
 void print_display_info(XcbWindow& w)
@@ -191,8 +250,235 @@ void print_event(XcbWindow& w, xcb_generic_event_t* event)
     }
 }
 
-int main ()
+int visible_lines(const TextView& view, int height)
+{
+    int cell_height = view.atlas->cell_height();
+    return (height + cell_height - 1)/cell_height;
+}
+
+// Lines that fit the window completely, the cursor is kept within these.
+int full_lines(const TextView& view, int height)
+{
+    return std::max(height/view.atlas->cell_height(), 1);
+}
+
+void scroll(TextView& view, int lines)
+{
+    int last_line = std::max<int>(view.line_buffer.line_count() - 1, 0);
+    view.first_line = std::clamp(view.first_line + lines, 0, last_line);
+}
+
+// Shows the cursor right away and starts the blink over, so it does not
+// disappear while it is being moved.
+void move_cursor(TextView& view, zest::x11::EventLoop& events,
+                 int line, int col)
+{
+    int last_line = std::max<int>(view.line_buffer.line_count() - 1, 0);
+    line = std::clamp(line, 0, last_line);
+    col = std::clamp<int>(col, 0, view.line_buffer.get_line(line).size());
+
+    view.damage.mark(view.cursor_line);
+    view.damage.mark(line);
+
+    view.cursor_line = line;
+    view.cursor_col = col;
+    view.cursor_visible = true;
+    events.restart_blink();
+}
+
+void keep_cursor_in_view(TextView& view, int height)
+{
+    int lines = full_lines(view, height);
+    if (view.cursor_line < view.first_line)
+        view.first_line = view.cursor_line;
+    else if (view.cursor_line >= view.first_line + lines)
+        view.first_line = view.cursor_line - lines + 1;
+}
+
+Keymap load_keymap(xcb_connection_t* connection)
+{
+    const xcb_setup_t* setup = xcb_get_setup(connection);
+
+    Keymap keymap;
+    keymap.min_keycode = setup->min_keycode;
+
+    xcb_get_keyboard_mapping_reply_t* reply = xcb_get_keyboard_mapping_reply(
+        connection,
+        xcb_get_keyboard_mapping(connection, setup->min_keycode,
+                                 setup->max_keycode - setup->min_keycode + 1),
+        nullptr);
+    if (!reply)
+        return keymap;
+
+    const xcb_keysym_t* keysyms = xcb_get_keyboard_mapping_keysyms(reply);
+    int length = xcb_get_keyboard_mapping_keysyms_length(reply);
+
+    keymap.keysyms_per_keycode = reply->keysyms_per_keycode;
+    keymap.keysyms.assign(keysyms, keysyms + length);
+    free(reply);
+
+    return keymap;
+}
+
+xcb_keysym_t keysym(const Keymap& keymap, xcb_keycode_t keycode)
+{
+    size_t index = size_t(keycode - keymap.min_keycode)
+                       *keymap.keysyms_per_keycode;
+    if (keycode < keymap.min_keycode || index >= keymap.keysyms.size())
+        return 0;
+
+    return keymap.keysyms[index];
+}
+
+void handle_key(TextView& view, zest::x11::EventLoop& events,
+                xcb_keysym_t key, int height)
+{
+    int line = view.cursor_line;
+    int col = view.cursor_col;
+    int page = full_lines(view, height);
+
+    switch (key)
+    {
+        case keysym_left:
+            if (col > 0)
+                col--;
+            else if (line > 0)
+                col = view.line_buffer.get_line(--line).size();
+            break;
+        case keysym_right:
+            if (col < int(view.line_buffer.get_line(line).size()))
+                col++;
+            else if (line + 1 < int(view.line_buffer.line_count()))
+                line++, col = 0;
+            break;
+        case keysym_up:
+            line--;
+            break;
+        case keysym_down:
+            line++;
+            break;
+        case keysym_page_up:
+            scroll(view, -page);
+            line -= page;
+            break;
+        case keysym_page_down:
+            scroll(view, page);
+            line += page;
+            break;
+        default:
+            return;
+    }
+
+    move_cursor(view, events, line, col);
+    keep_cursor_in_view(view, height);
+}
+
+void update_syntax_tree(TextView& view)
+{
+    std::optional<zest::tree_sitter::ParseResult> result =
+        view.parse_worker->take_result();
+    if (!result)
+        return;
+
+    view.highlight_cache.invalidate_changes(view.tree.get(),
+                                            result->tree.get());
+    view.tree = std::move(result->tree);
+}
+
+void update_highlights(TextView& view, int line_count)
+{
+    if (!view.tree)
+        return;
+
+    zest::highlight::LineRange rebuilt = view.highlight_cache.rebuild(
+        view.tree.get(), view.queries, view.query_cursor.get(),
+        std::max(0, view.first_line - highlight_margin),
+        view.first_line + line_count + highlight_margin);
+
+    view.damage.mark(rebuilt.first_line, rebuilt.last_line);
+}
+
+void draw_line(TextView& view, zest::Surface& surface, int line)
+{
+    zest::GlyphAtlas& atlas = *view.atlas;
+    int y = (line - view.first_line)*atlas.cell_height();
+
+    zest::fill_rect(surface, 0, y, surface.width, atlas.cell_height(),
+                    background_color);
+
+    if (size_t(line) >= view.line_buffer.line_count())
+        return;
+
+    std::string_view text = view.line_buffer.get_line(line);
+    atlas.draw_text(surface, 0, y, text, text_color);
+
+    if (view.tree && size_t(line) < view.highlight_cache.line_count())
+    {
+        for (const zest::highlight::Span& span :
+                 view.highlight_cache.spans(line))
+        {
+            size_t end = std::min<size_t>(span.end_col, text.size());
+            if (span.start_col >= end)
+                continue;
+
+            atlas.draw_text(surface, span.start_col*atlas.cell_width(), y,
+                            text.substr(span.start_col, end - span.start_col),
+                            zest::highlight::highlights[span.color].color);
+        }
+    }
+
+    if (line == view.cursor_line && view.cursor_visible)
+        zest::fill_rect(surface, view.cursor_col*atlas.cell_width(), y,
+                        cursor_width, atlas.cell_height(), cursor_color);
+}
+
+// Draws the damaged lines and presents each run of them as one band of
+// rows. With MIT-SHM nothing is drawn while the server still reads the
+// previous frame, the damage just waits for the next pass.
+void draw_frame(TextView& view, zest::x11::FrameBuffer& frame_buffer)
 {
+    if (!view.damage.any() || frame_buffer.busy())
+        return;
+
+    zest::Surface surface = frame_buffer.surface();
+    int cell_height = view.atlas->cell_height();
+
+    int line = view.damage.first_line();
+    int end = line + view.damage.line_count();
+    while (line < end)
+    {
+        if (!view.damage.is_dirty(line))
+        {
+            line++;
+            continue;
+        }
+
+        int first = line;
+        for (; line < end && view.damage.is_dirty(line); ++line)
+            draw_line(view, surface, line);
+
+        frame_buffer.present((first - view.first_line)*cell_height,
+                             (line - view.first_line)*cell_height);
+    }
+
+    view.damage.clear();
+}
+
+int main(int argc, char** argv)
+{
+    std::string file_path = argc < 2 ? "../main.cpp" : argv[1];
+
+    TextView view;
+    view.line_buffer = load_file(file_path);
+    view.font = zest::load_bdf_cached("../resources/terminus/ter-u18n.bdf");
+    view.atlas = std::make_unique<zest::GlyphAtlas>(
+        view.font->cell_width, view.font->cell_height,
+        [font = view.font] (uint32_t codepoint, zest::GlyphStyle,
+                            zest::GlyphCell cell)
+        {
+            return font->rasterize(codepoint, cell);
+        });
+
     XcbWindow w;
 
     w.connection = xcb_connect(NULL, &w.screen_number);
@@ -236,7 +522,10 @@ int main ()
     uint32_t value_mask = XCB_CW_EVENT_MASK;
     // fill in the attribute values
     xcb_create_window_value_list_t value_list;
-    value_list.event_mask = 0x01ffffff;
+    value_list.event_mask = XCB_EVENT_MASK_EXPOSURE
+                            | XCB_EVENT_MASK_STRUCTURE_NOTIFY
+                            | XCB_EVENT_MASK_BUTTON_PRESS
+                            | XCB_EVENT_MASK_KEY_PRESS;
     // serialize them
     void* value_list_buffer = NULL;
     xcb_create_window_value_list_serialize(&value_list_buffer, value_mask, &value_list);
@@ -270,22 +559,6 @@ int main ()
         return 1;
     }
 
-    std::vector<uint32_t> buffer(w.width*w.height);
-    for (int y = 0; y < w.height; ++y)
-    {
-        for (int x = 0; x < 200; ++x)
-        {
-            buffer[y*w.width + x] = 0x000000ff;
-        }
-    }
-    for (int y = 0; y < w.height; ++y)
-    {
-        for (int x = 200; x < w.width; ++x)
-        {
-            buffer[y*w.width + x] = 0x0000FF00;
-        }
-    }
-
     w.gc = xcb_generate_id(w.connection);
     xcb_void_cookie_t cookie = xcb_create_gc_checked (w.connection,
                             w.gc,
@@ -299,34 +572,144 @@ int main ()
         std::cout << "error: create_gc\n";
     }
 
-    cookie = xcb_put_image_checked (w.connection,
-                   XCB_IMAGE_FORMAT_Z_PIXMAP,
-                   w.id,
-                   w.gc,
-                   w.width,
-                   w.height,
-                   0,
-                   0,
-                   0,
-                   w.depth,
-                   buffer.size()*4,
-                   (const uint8_t*)buffer.data());
-    xcb_flush (w.connection);
-    err = xcb_request_check (w.connection, cookie);
-    if (err)
+    std::optional<zest::x11::FrameBuffer> frame_buffer;
+    frame_buffer.emplace(w.connection, w.id, w.gc, w.depth);
+    frame_buffer->resize(w.width, w.height);
+    std::cout << "Presenting with "
+              << (frame_buffer->uses_shm() ? "MIT-SHM" : "put_image") << "\n";
+
+    zest::x11::EventLoop events(w.connection, blink_interval_ms);
+    Keymap keymap = load_keymap(w.connection);
+
+    // The worker wakes the loop up when a tree is ready, instead of the
+    // loop checking for one every so often.
+    zest::tree_sitter::ParserPtr parser = zest::tree_sitter::init();
+    view.queries = zest::tree_sitter::init_highlight_queries(parser.get());
+    view.query_cursor = zest::tree_sitter::init_query_cursor();
+    view.parse_worker = std::make_unique<zest::tree_sitter::ParseWorker>(
+        std::move(parser), [&events] { events.notify(); });
+    view.highlight_cache.reset(view.line_buffer.line_count());
+    view.parse_worker->submit(view.line_buffer.snapshot(), {}, 0);
+
+    // Window size waiting to be applied once the server is done reading
+    // the frame buffer.
+    std::optional<std::pair<int, int>> pending_size;
+
+    // An event xcb read while flushing, poll does not see it on the fd.
+    xcb_generic_event_t* queued_event = nullptr;
+
+    while (!xcb_connection_has_error(w.connection))
     {
-        std::cout << "error: put_image\n";
-    }
+        // Everything that arrived since the last frame is handled before
+        // drawing, so a burst of key repeats or wheel clicks costs one
+        // frame instead of one per event.
+        while (xcb_generic_event_t* event =
+                   queued_event ? std::exchange(queued_event, nullptr)
+                                : xcb_poll_for_event(w.connection))
+        {
+            if (frame_buffer->handle_event(event))
+            {
+                free(event);
+                continue;
+            }
 
-    xcb_generic_event_t* event;// = xcb_wait_for_event(w.connection);
-    //print_event(event);
-    while (true)
-    {
-        event = xcb_poll_for_event(w.connection);
-        if (event)
-            print_event(w, event);
-        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            switch (event->response_type & 0x7f)
+            {
+                case XCB_EXPOSE:
+                {
+                    // The pixels are all still there, they just need to be
+                    // shown again.
+                    xcb_expose_event_t* e = (xcb_expose_event_t*)event;
+                    frame_buffer->present(e->y, e->y + e->height);
+                    break;
+                }
+                case XCB_CONFIGURE_NOTIFY:
+                {
+                    xcb_configure_notify_event_t* e =
+                        (xcb_configure_notify_event_t*)event;
+                    if (e->width != w.width || e->height != w.height)
+                        pending_size = { e->width, e->height };
+                    break;
+                }
+                case XCB_BUTTON_PRESS:
+                {
+                    xcb_button_press_event_t* e =
+                        (xcb_button_press_event_t*)event;
+                    if (e->detail == XCB_BUTTON_INDEX_1)
+                    {
+                        int cell_width = view.atlas->cell_width();
+                        move_cursor(view, events,
+                                    view.first_line
+                                        + e->event_y/view.atlas->cell_height(),
+                                    (e->event_x + cell_width/2)/cell_width);
+                    }
+                    else if (e->detail == XCB_BUTTON_INDEX_4)
+                        scroll(view, -scroll_lines);
+                    else if (e->detail == XCB_BUTTON_INDEX_5)
+                        scroll(view, scroll_lines);
+                    break;
+                }
+                case XCB_KEY_PRESS:
+                {
+                    xcb_key_press_event_t* e = (xcb_key_press_event_t*)event;
+                    handle_key(view, events, keysym(keymap, e->detail),
+                               w.height);
+                    break;
+                }
+                case XCB_MAPPING_NOTIFY:
+                {
+                    xcb_mapping_notify_event_t* e =
+                        (xcb_mapping_notify_event_t*)event;
+                    if (e->request == XCB_MAPPING_KEYBOARD)
+                        keymap = load_keymap(w.connection);
+                    break;
+                }
+                default:
+                    break;
+            }
+
+            free(event);
+        }
+
+        if (pending_size && !frame_buffer->busy())
+        {
+            w.width = pending_size->first;
+            w.height = pending_size->second;
+            frame_buffer->resize(w.width, w.height);
+            view.damage.mark_all();
+            pending_size.reset();
+        }
+
+        int lines = visible_lines(view, w.height);
+        view.damage.set_view(view.first_line, lines);
+
+        update_syntax_tree(view);
+        update_highlights(view, lines);
+
+        draw_frame(view, *frame_buffer);
+        xcb_flush(w.connection);
+
+        queued_event = xcb_poll_for_queued_event(w.connection);
+        if (queued_event)
+            continue;
+
+        // Sleeps until there is input, the cursor blinks, a parse finished
+        // or the server is done with the frame buffer, which all come in
+        // as events on the connection except the blink and the parse.
+        zest::x11::EventLoop::Wakeup wakeup = events.wait();
+        if (wakeup.blinks % 2)
+        {
+            view.cursor_visible = !view.cursor_visible;
+            view.damage.mark(view.cursor_line);
+        }
     }
 
+    // The worker calls into the event loop, it has to stop first.
+    view.parse_worker.reset();
+    free(queued_event);
+
+    frame_buffer.reset();
+    xcb_disconnect(w.connection);
+
     return 0;
 }
@@ -0,0 +1,220 @@
+#include <zest/editor.hpp>
+#include <zest/input.hpp>
+#include <zest/text.hpp>
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+
+// Drives the editor core with scripted keystrokes and checks the text and
+// the cursor after each of them. Exits with 1 when any check fails.
+
+using Key = zest::InputState::Key;
+using Command = zest::InputState::Command;
+
+static constexpr double frame_delta = 1.0/60.0;
+
+static int failures = 0;
+
+struct Fixture
+{
+    LineBuffer line_buffer;
+    Editor editor;
+    CursorState cursor;
+
+    explicit Fixture(std::string text)
+        : line_buffer(std::move(text))
+    {
+        init_editor(editor, 640, 480);
+        editor.highlight_cache.reset(line_buffer.line_count());
+    }
+
+    void put_cursor(int line, int col)
+    {
+        cursor.line = line;
+        cursor.col = col;
+        cursor.original_col = col;
+    }
+
+    void type(std::string_view text)
+    {
+        zest::InputState input;
+        input.text = text;
+        update(line_buffer, cursor, editor, input, frame_delta);
+    }
+
+    void press(Key key)
+    {
+        zest::InputState input;
+        input.key(key).pressed = true;
+        input.key(key).down = true;
+        update(line_buffer, cursor, editor, input, frame_delta);
+
+        // Lets go of the key, so the next press is not a repeat.
+        update(line_buffer, cursor, editor, {}, frame_delta);
+    }
+
+    void run(Command command)
+    {
+        zest::InputState input;
+        input.command(command) = true;
+        update(line_buffer, cursor, editor, input, frame_delta);
+    }
+
+    std::string text() const
+    {
+        std::string text;
+        for (size_t offset = 0; offset < line_buffer.size();)
+        {
+            std::string_view chunk = line_buffer.chunk_at(offset);
+            text += chunk;
+            offset += chunk.size();
+        }
+        return text;
+    }
+};
+
+static void check(bool ok, std::string_view what)
+{
+    if (!ok)
+    {
+        std::cerr << "FAILED: " << what << "\n";
+        failures++;
+    }
+}
+
+static void check_text(const Fixture& fixture, std::string_view expected,
+                       std::string_view what)
+{
+    std::string text = fixture.text();
+    if (text != expected)
+    {
+        std::cerr << "FAILED: " << what << ": got '" << text
+                  << "', expected '" << expected << "'\n";
+        failures++;
+    }
+}
+
+static void check_cursor(const Fixture& fixture, int line, int col,
+                         std::string_view what)
+{
+    if (fixture.cursor.line != line || fixture.cursor.col != col)
+    {
+        std::cerr << "FAILED: " << what << ": cursor at "
+                  << fixture.cursor.line << ":" << fixture.cursor.col
+                  << ", expected " << line << ":" << col << "\n";
+        failures++;
+    }
+}
+
+// "é" takes two bytes, "€" three and "😀" four.
+static void erase_multi_byte()
+{
+    Fixture fixture("");
+    fixture.type("a\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80" "b");
+    check_cursor(fixture, 0, 11, "typing puts the cursor after the text");
+
+    fixture.press(Key::backspace);
+    check_text(fixture, "a\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80",
+               "backspace after an ASCII character");
+
+    fixture.press(Key::backspace);
+    check_text(fixture, "a\xc3\xa9\xe2\x82\xac",
+               "backspace after a four byte character");
+    check_cursor(fixture, 0, 6, "backspace after a four byte character");
+
+    fixture.press(Key::backspace);
+    check_text(fixture, "a\xc3\xa9", "backspace after a three byte character");
+
+    fixture.put_cursor(0, 1);
+    fixture.press(Key::del);
+    check_text(fixture, "a", "delete before a two byte character");
+    check_cursor(fixture, 0, 1, "delete before a two byte character");
+}
+
+static void move_over_multi_byte()
+{
+    Fixture fixture("a\xc3\xa9\xe2\x82\xac\nx\xf0\x9f\x98\x80");
+    fixture.put_cursor(0, 6);
+
+    fixture.press(Key::left);
+    check_cursor(fixture, 0, 3, "left over a three byte character");
+    fixture.press(Key::left);
+    check_cursor(fixture, 0, 1, "left over a two byte character");
+    fixture.press(Key::right);
+    check_cursor(fixture, 0, 3, "right over a two byte character");
+    fixture.press(Key::right);
+    check_cursor(fixture, 0, 6, "right over a three byte character");
+
+    // Straight down would be inside the four byte character.
+    fixture.put_cursor(0, 3);
+    fixture.press(Key::down);
+    check_cursor(fixture, 1, 1, "down into a four byte character");
+    fixture.press(Key::right);
+    check_cursor(fixture, 1, 5, "right over a four byte character");
+}
+
+static void erase_at_every_cursor()
+{
+    Fixture fixture("\xc3\xa9x\n\xc3\xa9y\n");
+    fixture.put_cursor(0, 2);
+    fixture.editor.extra_cursors.push_back({ { 1, 2 }, { 1, 2 } });
+    fixture.editor.cursors_version++;
+
+    fixture.press(Key::backspace);
+    check_text(fixture, "x\ny\n", "backspace at every cursor");
+
+    fixture.put_cursor(0, 0);
+    fixture.editor.extra_cursors.clear();
+    fixture.editor.cursors_version++;
+    fixture.type("\xe2\x82\xac");
+    fixture.press(Key::left);
+    fixture.press(Key::del);
+    check_text(fixture, "x\ny\n", "delete after moving left");
+    check(fixture.cursor.col == 0, "delete keeps the cursor in place");
+}
+
+// A step made at several cursors comes back from the history as one
+// replace, whether its operations grow or shrink the text.
+static void undo_at_every_cursor()
+{
+    Fixture fixture("ab\ncd\nef");
+    fixture.put_cursor(0, 1);
+    fixture.editor.extra_cursors.push_back({ { 1, 1 }, { 1, 1 } });
+    fixture.editor.extra_cursors.push_back({ { 2, 1 }, { 2, 1 } });
+    fixture.editor.cursors_version++;
+
+    fixture.type("xyz");
+    check_text(fixture, "axyzb\ncxyzd\nexyzf", "typing at every cursor");
+    fixture.press(Key::backspace);
+    check_text(fixture, "axyb\ncxyd\nexyf", "erasing at every cursor");
+
+    fixture.run(Command::undo);
+    check_text(fixture, "axyzb\ncxyzd\nexyzf", "undo of the erasing");
+    fixture.run(Command::undo);
+    check_text(fixture, "ab\ncd\nef", "undo of the typing");
+    check_cursor(fixture, 2, 1, "undo puts the main cursor last");
+
+    fixture.run(Command::redo);
+    fixture.run(Command::redo);
+    check_text(fixture, "axyb\ncxyd\nexyf", "redo of both steps");
+}
+
+int main()
+{
+    erase_multi_byte();
+    move_over_multi_byte();
+    erase_at_every_cursor();
+    undo_at_every_cursor();
+
+    if (failures > 0)
+    {
+        std::cerr << failures << " checks failed\n";
+        return 1;
+    }
+
+    std::cerr << "All checks passed\n";
+    return 0;
+}